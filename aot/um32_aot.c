@@ -0,0 +1,225 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#include "um32_instruction.h"
+#include "um32_machine.h"
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Ahead-of-time translator. Reads a program scroll with the machine's own
+// loader and writes a C file implementing its '0' array, to be compiled and
+// linked against libum32:
+//
+//     ./um32_aot.out program.um program.c
+//     cc -std=c99 -O2 -I. -o program program.c libum32.a -pthread
+//
+// Every offset becomes a labelled block built from the UM32_AOT_* macros in
+// um32_aot.h, and Load Program jumps within the '0' array go through a switch
+// over all offsets. Translation is platter by platter, so data stored in the
+// '0' array is translated as well; it is simply never reached.
+//
+
+// Writes the code for a single instruction
+//
+static void
+um32_aot_translateInstruction(FILE* file_p, um32_instruction_t instruction,
+                              uint32_t offset)
+{
+    unsigned a = instruction.regA;
+    unsigned b = instruction.regB;
+    unsigned c = instruction.regC;
+
+    switch (um32_instruction_baseOperator(instruction.operatorNum))
+    {
+    case UM32_OPERATOR_CONDITIONAL_MOVE:
+        fprintf(file_p, "UM32_AOT_CONDITIONAL_MOVE(%u, %u, %u)", a, b, c);
+        break;
+    case UM32_OPERATOR_ARRAY_INDEX:
+        fprintf(file_p, "UM32_AOT_ARRAY_INDEX(%u, %u, %u)", a, b, c);
+        break;
+    case UM32_OPERATOR_ARRAY_AMENDMENT:
+        fprintf(file_p, "UM32_AOT_ARRAY_AMENDMENT(%" PRIu32 ", %u, %u, %u)",
+                offset, a, b, c);
+        break;
+    case UM32_OPERATOR_ADDITION:
+        fprintf(file_p, "UM32_AOT_ADDITION(%u, %u, %u)", a, b, c);
+        break;
+    case UM32_OPERATOR_MULTIPLICATION:
+        fprintf(file_p, "UM32_AOT_MULTIPLICATION(%u, %u, %u)", a, b, c);
+        break;
+    case UM32_OPERATOR_DIVISION:
+        fprintf(file_p, "UM32_AOT_DIVISION(%" PRIu32 ", %u, %u, %u)",
+                offset, a, b, c);
+        break;
+    case UM32_OPERATOR_NOT_AND:
+        fprintf(file_p, "UM32_AOT_NOT_AND(%u, %u, %u)", a, b, c);
+        break;
+    case UM32_OPERATOR_HALT:
+        fprintf(file_p, "UM32_AOT_HALT(%" PRIu32 ")", offset);
+        break;
+    case UM32_OPERATOR_ALLOCATION:
+        fprintf(file_p, "UM32_AOT_ALLOCATION(%u, %u)", b, c);
+        break;
+    case UM32_OPERATOR_ABANDONMENT:
+        fprintf(file_p, "UM32_AOT_ABANDONMENT(%u)", c);
+        break;
+    case UM32_OPERATOR_OUTPUT:
+    case UM32_OPERATOR_INPUT:
+        fprintf(file_p, "UM32_AOT_INTERPRET(%" PRIu32 ");", offset);
+        break;
+    case UM32_OPERATOR_LOAD_PROGRAM:
+        fprintf(file_p, "UM32_AOT_LOAD_PROGRAM(%" PRIu32 ", %u, %u)",
+                offset, b, c);
+        break;
+    case UM32_OPERATOR_ORTHOGRAPHY:
+        fprintf(file_p, "UM32_AOT_ORTHOGRAPHY(%u, %" PRIu32 "u)", a,
+                instruction.value);
+        break;
+    default:
+        // Operators 14 and 15 are skipped, as in the interpreter
+        //
+        fprintf(file_p, ";");
+        break;
+    }
+}
+
+static bool
+um32_aot_translate(FILE* file_p, const char* programName,
+                   um32_array_storage_pt image_p)
+{
+    uint32_t length = image_p->length;
+
+    fprintf(file_p, "// Translated from %s by um32_aot\n", programName);
+    fprintf(file_p, "//\n");
+    fprintf(file_p, "#include \"um32_aot.h\"\n\n");
+
+    fprintf(file_p, "static const uint32_t um32_aot_image_a[%" PRIu32 "] =\n{",
+            (length > 0) ? length : 1);
+    for (uint32_t i=0; i<length; i++)
+    {
+        fprintf(file_p, "%s0x%08" PRIx32 ",", ((i % 6) == 0) ? "\n   " : "",
+                um32_platter_toUInt32(image_p->platters_a[i]));
+    }
+    fprintf(file_p, "%s\n};\n\n", (length > 0) ? "" : "\n    0");
+
+    fprintf(file_p, "static bool\n");
+    fprintf(file_p, "um32_aot_program(um32_machine_pt machine_p)\n");
+    fprintf(file_p, "{\n");
+    fprintf(file_p, "    UM32_AOT_PROLOGUE();\n\n");
+    for (uint32_t i=0; i<length; i++)
+    {
+        fprintf(file_p, "L%" PRIu32 ":\n    ", i);
+        um32_aot_translateInstruction(file_p, image_p->decoded_p[i], i);
+        fprintf(file_p, "\n");
+    }
+    fprintf(file_p, "    UM32_AOT_END(%" PRIu32 ")\n\n", length);
+
+    fprintf(file_p, "dispatch:\n");
+    fprintf(file_p, "    switch (offset)\n");
+    fprintf(file_p, "    {\n");
+    for (uint32_t i=0; i<length; i++)
+    {
+        fprintf(file_p, "    case %" PRIu32 ": goto L%" PRIu32 ";\n", i, i);
+    }
+    fprintf(file_p, "    default: UM32_AOT_END(%" PRIu32 ")\n", length);
+    fprintf(file_p, "    }\n");
+    fprintf(file_p, "}\n\n");
+
+    fprintf(file_p, "int\n");
+    fprintf(file_p, "main(int argc, char* argv[])\n");
+    fprintf(file_p, "{\n");
+    fprintf(file_p, "    return um32_aot_main(argc, argv, um32_aot_image_a, "
+            "%" PRIu32 ",\n                         um32_aot_program);\n",
+            length);
+    fprintf(file_p, "}\n");
+
+    return !ferror(file_p);
+}
+
+void
+printUsage(void)
+{
+    printf("Usage: um32_aot FILE OUTPUT\n");
+    printf("Translates the program in FILE to C source in OUTPUT.\n");
+}
+
+int
+main(int argc, char* argv[])
+{
+    if ((argc == 2) &&
+        ((strcmp(argv[1], "-h") == 0) || (strcmp(argv[1], "--help") == 0)))
+    {
+        printUsage();
+        return -1;
+    }
+
+    if (argc != 3)
+    {
+        printf("Invalid number of arguments.\n");
+        printUsage();
+        return -1;
+    }
+
+    FILE* file_p = fopen(argv[1], "r");
+    if (file_p == NULL)
+    {
+        printf("Unable to open file.\n");
+        return -1;
+    }
+
+    um32_array_storage_pt image_p = um32_machine_createImage(file_p);
+    fclose(file_p);
+    if (image_p == NULL)
+    {
+        printf("Unable to read program.\n");
+        return -1;
+    }
+
+    FILE* output_p = fopen(argv[2], "w");
+    if (output_p == NULL)
+    {
+        printf("Unable to open output file.\n");
+        um32_array_storage_freeShared(image_p);
+        return -1;
+    }
+
+    bool result = um32_aot_translate(output_p, argv[1], image_p);
+    result = (fclose(output_p) == 0) && result;
+    um32_array_storage_freeShared(image_p);
+
+    if (!result)
+    {
+        printf("Unable to write output file.\n");
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,273 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// Benchmark driver. Runs each case once with a build that counts instructions
+// and then several times with the build being measured, and prints one line of
+// comma-separated results per case:
+//
+//     case,instructions,seconds,mips,read_calls,write_calls,max_rss_kb
+//
+// The time is the best of the timed runs and the peak resident set size the
+// largest. A case is given as PROGRAM or PROGRAM:INPUT, where INPUT is fed to
+// the console; program output is discarded. With --translated, the build being
+// measured is a program translated by um32_aot.out and is run without
+// arguments, while the counting build still runs PROGRAM.
+//
+#define UM32_BENCH_DEFAULT_REPEAT 3
+
+typedef struct
+{
+    uint64_t  instructions;
+    uint64_t  readCalls;
+    uint64_t  writeCalls;
+    double    seconds;
+    long      maxRssKb;
+} um32_bench_result_t;
+typedef um32_bench_result_t* um32_bench_result_pt;
+
+// Runs vmName on programName with inputName as console input, recording the
+// wall time and peak resident set size. A NULL programName runs vmName without
+// arguments, as a translated program. When parseStats is set, the counters
+// the machine reports with --stats are recorded as well. Returns false if the
+// machine could not be run or did not exit cleanly.
+//
+static bool
+um32_bench_run(const char* vmName, const char* programName,
+               const char* inputName, um32_bench_result_pt result_p,
+               bool parseStats)
+{
+    int statsPipe_a[2] = { -1, -1 };
+    if (parseStats && (pipe(statsPipe_a) == -1)) { return false; }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    pid_t pid = fork();
+    if (pid == -1) { return false; }
+    if (pid == 0)
+    {
+        int inputFd = open((inputName != NULL) ? inputName : "/dev/null",
+                           O_RDONLY);
+        int nullFd = open("/dev/null", O_WRONLY);
+        if ((inputFd == -1) || (nullFd == -1)) { _exit(127); }
+
+        dup2(inputFd, 0);
+        dup2(nullFd, 1);
+        dup2(parseStats ? statsPipe_a[1] : nullFd, 2);
+        if (parseStats) { close(statsPipe_a[0]); }
+
+        if (programName == NULL) { execl(vmName, vmName, (char*)NULL); }
+        else { execl(vmName, vmName, "--stats", programName, (char*)NULL); }
+        _exit(127);
+    }
+
+    if (parseStats)
+    {
+        close(statsPipe_a[1]);
+
+        FILE* stats_p = fdopen(statsPipe_a[0], "r");
+        char line_a[256];
+        while ((stats_p != NULL) && (fgets(line_a, sizeof(line_a), stats_p) != NULL))
+        {
+            uint64_t val;
+            if (sscanf(line_a, "Instructions: %" SCNu64, &val) == 1)
+            {
+                result_p->instructions = val;
+            }
+            else if (sscanf(line_a, "Read calls: %" SCNu64, &val) == 1)
+            {
+                result_p->readCalls = val;
+            }
+            else if (sscanf(line_a, "Write calls: %" SCNu64, &val) == 1)
+            {
+                result_p->writeCalls = val;
+            }
+        }
+        if (stats_p != NULL) { fclose(stats_p); }
+        else { close(statsPipe_a[0]); }
+    }
+
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) == -1) { return false; }
+
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    result_p->seconds = (double)(end.tv_sec - start.tv_sec) +
+                        (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    result_p->maxRssKb = usage.ru_maxrss;
+
+    return WIFEXITED(status) && (WEXITSTATUS(status) == 0);
+}
+
+// Benchmarks a single PROGRAM[:INPUT] case and prints its results
+//
+static bool
+um32_bench_case(const char* countingVmName, const char* vmName,
+                const char* caseSpec, int repeat, bool translated)
+{
+    char* programName = strdup(caseSpec);
+    if (programName == NULL) { return false; }
+
+    char* inputName = strchr(programName, ':');
+    if (inputName != NULL)
+    {
+        *(inputName++) = '\0';
+        if (*inputName == '\0') { inputName = NULL; }
+    }
+
+    // Name the case after the program file, without directory or extension
+    //
+    const char* caseName = strrchr(programName, '/');
+    caseName = (caseName != NULL) ? (caseName + 1) : programName;
+    size_t caseNameLength = strcspn(caseName, ".");
+
+    um32_bench_result_t counted;
+    memset(&counted, 0, sizeof(counted));
+    if (!um32_bench_run(countingVmName, programName, inputName, &counted, true))
+    {
+        fprintf(stderr, "Unable to run %s.\n", caseSpec);
+        free(programName);
+        return false;
+    }
+
+    um32_bench_result_t best;
+    memset(&best, 0, sizeof(best));
+    for (int i=0; i<repeat; i++)
+    {
+        um32_bench_result_t timed;
+        memset(&timed, 0, sizeof(timed));
+        if (!um32_bench_run(vmName, translated ? NULL : programName,
+                            inputName, &timed, false))
+        {
+            fprintf(stderr, "Unable to run %s.\n", caseSpec);
+            free(programName);
+            return false;
+        }
+
+        if ((i == 0) || (timed.seconds < best.seconds))
+        {
+            best.seconds = timed.seconds;
+        }
+        if (timed.maxRssKb > best.maxRssKb) { best.maxRssKb = timed.maxRssKb; }
+    }
+
+    double mips = (best.seconds > 0.0)
+        ? ((double)counted.instructions / best.seconds / 1e6)
+        : 0.0;
+    printf("%.*s,%" PRIu64 ",%.4f,%.1f,%" PRIu64 ",%" PRIu64 ",%ld\n",
+           (int)caseNameLength, caseName, counted.instructions, best.seconds,
+           mips, counted.readCalls, counted.writeCalls, best.maxRssKb);
+    fflush(stdout);
+
+    free(programName);
+    return true;
+}
+
+void
+printUsage(void)
+{
+    printf("Usage: um32_bench [OPTIONS] COUNTING_VM VM CASE...\n");
+    printf("Options:\n");
+    printf("  -h, --help          display this information\n");
+    printf("  --repeat N          time each case N times (default %d)\n",
+           UM32_BENCH_DEFAULT_REPEAT);
+    printf("  --translated        VM is a translated program and is run\n");
+    printf("                      without arguments\n");
+    printf("Cases are given as PROGRAM or PROGRAM:INPUT.\n");
+}
+
+int
+main(int argc, char* argv[])
+{
+    int repeat = UM32_BENCH_DEFAULT_REPEAT;
+    bool translated = false;
+    int i = 1;
+    for (; (i < argc) && (argv[i][0] == '-'); i++)
+    {
+        if ((strcmp(argv[i], "-h") == 0) || (strcmp(argv[i], "--help") == 0))
+        {
+            printUsage();
+            return -1;
+        }
+        else if ((strcmp(argv[i], "--repeat") == 0) && (i + 1 < argc) &&
+                 (atoi(argv[i + 1]) > 0))
+        {
+            repeat = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--translated") == 0)
+        {
+            translated = true;
+        }
+        else
+        {
+            printf("Invalid arguments.\n");
+            printUsage();
+            return -1;
+        }
+    }
+
+    if (argc - i < 3)
+    {
+        printf("Invalid number of arguments.\n");
+        printUsage();
+        return -1;
+    }
+
+    const char* countingVmName = argv[i++];
+    const char* vmName = argv[i++];
+
+    printf("case,instructions,seconds,mips,read_calls,write_calls,max_rss_kb\n");
+
+    int result = 0;
+    for (; i<argc; i++)
+    {
+        if (!um32_bench_case(countingVmName, vmName, argv[i], repeat,
+                             translated))
+        {
+            result = -1;
+        }
+    }
+
+    return result;
+}
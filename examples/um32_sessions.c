@@ -0,0 +1,299 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#include "um32_machine.h"
+#include "um32_scheduler.h"
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Scheduler example. Serves numSessions machines running an echo program, such
+// as bench/echo.um, from a single scheduler thread, each with a socket pair as
+// its console. A client process writes a different input to every session and
+// checks that each is echoed back unchanged. The client does not read the
+// first session until all the others have finished, so the run only completes
+// if a client that stops reading stalls nothing but its own machine:
+//
+//     ./um32_sessions.out bench/echo.um 64
+//
+#define UM32_SESSIONS_INPUT_SIZE  (256 * 1024)
+#define UM32_SESSIONS_SEND_BUFFER 4096
+#define UM32_SESSIONS_TIMEOUT_MS  10000
+
+typedef struct
+{
+    int  numHalted;
+    int  numFailed;
+} um32_sessions_host_t;
+typedef um32_sessions_host_t* um32_sessions_host_pt;
+
+static unsigned char
+um32_sessions_inputByte(int session, size_t offset)
+{
+    return (unsigned char)('a' + ((size_t)session * 7 + offset) % 26);
+}
+
+static void
+um32_sessions_done(void* context_p, um32_machine_pt machine_p,
+                   um32_machine_status_t status)
+{
+    um32_sessions_host_pt host_p = (um32_sessions_host_pt)context_p;
+
+    if (status == UM32_MACHINE_STATUS_HALTED) { host_p->numHalted++; }
+    else { host_p->numFailed++; }
+
+    // Closing the console tells the client the session is over
+    //
+    close(machine_p->inputFd);
+    um32_machine_free(machine_p);
+}
+
+// Feeds every session its input and checks what comes back. Returns the exit
+// status of the client process.
+//
+static int
+um32_sessions_client(const int* fds_p, int numSessions)
+{
+    size_t* written_p = (size_t*)calloc((size_t)numSessions, sizeof(size_t));
+    size_t* read_p = (size_t*)calloc((size_t)numSessions, sizeof(size_t));
+    bool* done_p = (bool*)calloc((size_t)numSessions, sizeof(bool));
+    struct pollfd* pollFds_p =
+        (struct pollfd*)calloc((size_t)numSessions, sizeof(struct pollfd));
+    int* sessions_p = (int*)calloc((size_t)numSessions, sizeof(int));
+    if ((written_p == NULL) || (read_p == NULL) || (done_p == NULL) ||
+        (pollFds_p == NULL) || (sessions_p == NULL))
+    {
+        printf("Unable to allocate client.\n");
+        return 1;
+    }
+
+    unsigned char buffer_a[UM32_SESSIONS_SEND_BUFFER];
+    int numDone = 0;
+    while (numDone < numSessions)
+    {
+        int numPollFds = 0;
+        for (int i=0; i<numSessions; i++)
+        {
+            if (done_p[i]) { continue; }
+
+            short events = 0;
+            if (written_p[i] < UM32_SESSIONS_INPUT_SIZE) { events |= POLLOUT; }
+            if ((i > 0) || (numDone == numSessions - 1)) { events |= POLLIN; }
+            if (events == 0) { continue; }
+
+            pollFds_p[numPollFds].fd = fds_p[i];
+            pollFds_p[numPollFds].events = events;
+            sessions_p[numPollFds++] = i;
+        }
+
+        int numReady = poll(pollFds_p, (nfds_t)numPollFds,
+                            UM32_SESSIONS_TIMEOUT_MS);
+        if ((numReady == -1) && (errno == EINTR)) { continue; }
+        if (numReady <= 0)
+        {
+            printf("Sessions stalled with %d of %d finished.\n", numDone,
+                   numSessions);
+            return 1;
+        }
+
+        for (int p=0; p<numPollFds; p++)
+        {
+            int i = sessions_p[p];
+            short revents = pollFds_p[p].revents;
+
+            if ((revents & POLLOUT) != 0)
+            {
+                size_t size = UM32_SESSIONS_INPUT_SIZE - written_p[i];
+                if (size > sizeof(buffer_a)) { size = sizeof(buffer_a); }
+                for (size_t j=0; j<size; j++)
+                {
+                    buffer_a[j] = um32_sessions_inputByte(i, written_p[i] + j);
+                }
+
+                ssize_t numBytes = send(fds_p[i], buffer_a, size,
+                                        MSG_DONTWAIT | MSG_NOSIGNAL);
+                if (numBytes > 0) { written_p[i] += (size_t)numBytes; }
+                if (written_p[i] == UM32_SESSIONS_INPUT_SIZE)
+                {
+                    shutdown(fds_p[i], SHUT_WR);
+                }
+            }
+
+            if ((revents & (POLLIN | POLLHUP | POLLERR)) != 0)
+            {
+                ssize_t numBytes = recv(fds_p[i], buffer_a, sizeof(buffer_a),
+                                        MSG_DONTWAIT);
+                if ((numBytes == -1) &&
+                    ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+                {
+                    continue;
+                }
+                if (numBytes <= 0)
+                {
+                    if (read_p[i] != UM32_SESSIONS_INPUT_SIZE)
+                    {
+                        printf("Session %d ended after %zu of %d bytes.\n", i,
+                               read_p[i], UM32_SESSIONS_INPUT_SIZE);
+                        return 1;
+                    }
+                    done_p[i] = true;
+                    numDone++;
+                    continue;
+                }
+
+                for (ssize_t j=0; j<numBytes; j++)
+                {
+                    if (buffer_a[j] != um32_sessions_inputByte(i, read_p[i] + j))
+                    {
+                        printf("Session %d echoed the wrong byte at %zu.\n", i,
+                               read_p[i] + j);
+                        return 1;
+                    }
+                }
+                read_p[i] += (size_t)numBytes;
+            }
+        }
+    }
+
+    return 0;
+}
+
+int
+main(int argc, char* argv[])
+{
+    int numSessions = (argc == 3) ? atoi(argv[2]) : 0;
+    if (numSessions <= 0)
+    {
+        printf("Usage: %s PROGRAM SESSIONS\n", argv[0]);
+        return -1;
+    }
+
+    FILE* file_p = fopen(argv[1], "r");
+    um32_array_storage_pt image_p =
+        (file_p != NULL) ? um32_machine_createImage(file_p) : NULL;
+    if (file_p != NULL) { fclose(file_p); }
+    if (image_p == NULL)
+    {
+        printf("Unable to load program.\n");
+        return -1;
+    }
+
+    int* hostFds_p = (int*)calloc((size_t)numSessions, sizeof(int));
+    int* clientFds_p = (int*)calloc((size_t)numSessions, sizeof(int));
+    if ((hostFds_p == NULL) || (clientFds_p == NULL))
+    {
+        printf("Unable to allocate sessions.\n");
+        return -1;
+    }
+
+    // Small send buffers make machines fill their sockets and wait for output
+    //
+    for (int i=0; i<numSessions; i++)
+    {
+        int pair_a[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair_a) == -1)
+        {
+            printf("Unable to create console.\n");
+            return -1;
+        }
+        int sendBuffer = UM32_SESSIONS_SEND_BUFFER;
+        setsockopt(pair_a[0], SOL_SOCKET, SO_SNDBUF, &sendBuffer,
+                   sizeof(sendBuffer));
+        hostFds_p[i] = pair_a[0];
+        clientFds_p[i] = pair_a[1];
+    }
+
+    fflush(stdout);
+    pid_t client = fork();
+    if (client == -1)
+    {
+        printf("Unable to start client.\n");
+        return -1;
+    }
+    if (client == 0)
+    {
+        for (int i=0; i<numSessions; i++) { close(hostFds_p[i]); }
+        int result = um32_sessions_client(clientFds_p, numSessions);
+        fflush(stdout);
+        _exit(result);
+    }
+    for (int i=0; i<numSessions; i++) { close(clientFds_p[i]); }
+
+    // A client that hangs up must not kill the host
+    //
+    signal(SIGPIPE, SIG_IGN);
+
+    um32_sessions_host_t host;
+    memset(&host, 0, sizeof(host));
+    um32_scheduler_pt scheduler_p = um32_scheduler_create(
+        UM32_SCHEDULER_DEFAULT_SLICE, um32_sessions_done, &host);
+    if (scheduler_p == NULL)
+    {
+        printf("Unable to create scheduler.\n");
+        return -1;
+    }
+
+    for (int i=0; i<numSessions; i++)
+    {
+        um32_machine_pt machine_p = um32_machine_create();
+        if ((machine_p == NULL) ||
+            !um32_machine_initFromImage(machine_p, image_p) ||
+            !um32_machine_setOutput(machine_p, hostFds_p[i]) ||
+            !um32_scheduler_add(scheduler_p, machine_p, hostFds_p[i]))
+        {
+            printf("Unable to start session %d.\n", i);
+            return -1;
+        }
+        um32_machine_setOutputBuffering(machine_p,
+                                        UM32_MACHINE_OUTPUT_FULLY_BUFFERED);
+    }
+
+    bool scheduled = um32_scheduler_run(scheduler_p);
+    um32_scheduler_free(scheduler_p);
+    um32_array_storage_freeShared(image_p);
+
+    int clientStatus;
+    waitpid(client, &clientStatus, 0);
+    bool clientOk = WIFEXITED(clientStatus) && (WEXITSTATUS(clientStatus) == 0);
+
+    printf("%d sessions: %d halted, %d failed, client %s\n", numSessions,
+           host.numHalted, host.numFailed, clientOk ? "ok" : "failed");
+
+    free(clientFds_p);
+    free(hostFds_p);
+
+    return (scheduled && clientOk && (host.numHalted == numSessions)) ? 0 : -1;
+}
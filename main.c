@@ -26,16 +26,145 @@
 // SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 //
 //******************************************************************************
+#include "um32_batch.h"
+#include "um32_console.h"
 #include "um32_machine.h"
+#include "um32_server.h"
+#include <fcntl.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <signal.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+void
+printMemoryStats(const um32_memory_stats_t* stats_p, uint64_t residentBytes)
+{
+    double hitRate = (stats_p->poolAllocations == 0)
+        ? 0.0
+        : (100.0 * (double)stats_p->poolReuses / (double)stats_p->poolAllocations);
+
+    fprintf(stderr, "Pool allocations:     %" PRIu64 " (%.1f%% reused)\n",
+            stats_p->poolAllocations, hitRate);
+    fprintf(stderr, "Pool deallocations:   %" PRIu64 "\n",
+            stats_p->poolDeallocations);
+    fprintf(stderr, "Pool slabs:           %" PRIu64 "\n", stats_p->slabs);
+    fprintf(stderr, "System allocations:   %" PRIu64 "\n",
+            stats_p->systemAllocations);
+    fprintf(stderr, "System deallocations: %" PRIu64 "\n",
+            stats_p->systemDeallocations);
+    fprintf(stderr, "Map allocations:      %" PRIu64 "\n",
+            stats_p->mapAllocations);
+    fprintf(stderr, "Map deallocations:    %" PRIu64 "\n",
+            stats_p->mapDeallocations);
+    fprintf(stderr, "Mapped bytes:         %" PRIu64 " (%" PRIu64
+            " resident, peak %" PRIu64 ")\n", stats_p->mappedBytes,
+            residentBytes, stats_p->peakMappedBytes);
+
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+    {
+        fprintf(stderr, "Peak resident set:    %ld KiB\n", usage.ru_maxrss);
+    }
+}
+
+void
+printMachineStats(const um32_machine_stats_t* stats_p)
+{
+    fprintf(stderr, "Instructions:         %" PRIu64 "\n", stats_p->instructions);
+    fprintf(stderr, "Read calls:           %" PRIu64 "\n", stats_p->readCalls);
+    fprintf(stderr, "Write calls:          %" PRIu64 "\n", stats_p->writeCalls);
+}
+
+void
+handleSnapshotSignal(int signalNum)
+{
+    (void)signalNum;
+    um32_machine_requestSnapshot();
+}
+
+void
+handleSampleSignal(int signalNum)
+{
+    (void)signalNum;
+    um32_machine_requestSample();
+}
+
+// Delivers SIGPROF every interval microseconds of CPU time, or stops it if
+// interval is 0
+//
+void
+setSampleTimer(long interval)
+{
+    struct itimerval timer;
+    timer.it_interval.tv_sec = interval / 1000000;
+    timer.it_interval.tv_usec = interval % 1000000;
+    timer.it_value = timer.it_interval;
+    setitimer(ITIMER_PROF, &timer, NULL);
+}
 
 void
 printUsage(void)
 {
     printf("Usage: um32 [OPTIONS] FILE\n");
+    printf("       um32 [OPTIONS] --restore SNAPSHOT\n");
+    printf("       um32 --batch [--jobs N] FILE INPUT...\n");
+    printf("       um32 --batch --fork-after N|--fork-at-input [--input FILE]\n");
+    printf("            [--jobs N] FILE INPUT...\n");
+    printf("       um32 --batch --fork-at-marker BYTE --input FILE [--jobs N]\n");
+    printf("            FILE INPUT...\n");
+    printf("       um32 --serve SOCKET [--jobs N] FILE...\n");
+    printf("       um32 --connect SOCKET [--input FILE] NAME\n");
+    printf("       um32 --decode-trace TRACE\n");
     printf("Options:\n");
     printf("  -h, --help          display this information\n");
+    printf("  --async-io          service the console from a reader and a writer\n");
+    printf("                      thread so that slow terminals and pipes do not\n");
+    printf("                      stall the machine\n");
+    printf("  --batch             run FILE once per INPUT in parallel, writing\n");
+    printf("                      the output of each to INPUT.out\n");
+    printf("  --connect SOCKET    run the program NAME, the file name of a\n");
+    printf("                      program loaded by --serve, on this console\n");
+    printf("  --decode-trace TRACE\n");
+    printf("                      print the instructions recorded in TRACE\n");
+    printf("  --fork-after N      run a batch once for N instructions, then fork\n");
+    printf("                      a process per INPUT to finish it; --input\n");
+    printf("                      feeds the shared part of the run\n");
+    printf("  --fork-at-input     as --fork-after, forking at the first Input\n");
+    printf("                      after the run has read all of --input\n");
+    printf("  --fork-at-marker BYTE\n");
+    printf("                      as --fork-after, forking at the first Input\n");
+    printf("                      after the run has read the first BYTE, a\n");
+    printf("                      number such as 10 or 0x0a, of --input\n");
+    printf("  --jobs N            number of batch threads or server workers\n");
+    printf("                      (default: one per CPU)\n");
+    printf("  --huge-pages        back large arrays with transparent huge pages\n");
+    printf("  --input FILE        read console input from FILE instead of\n");
+    printf("                      standard input\n");
+    printf("  --memory-stats      report guest array allocation counters on exit\n");
+    printf("  --output-buffering MODE\n");
+    printf("                      flush output at the end of every line (line)\n");
+    printf("                      or only when the buffer is full (full);\n");
+    printf("                      defaults to line on a terminal, else full\n");
+    printf("  --profile           report operator, allocation and hot offset\n");
+    printf("                      counts on exit (PROFILE=1 builds only)\n");
+    printf("  --restore SNAPSHOT  resume the machine saved in SNAPSHOT\n");
+    printf("  --serve SOCKET      load each FILE once and run them for clients\n");
+    printf("                      connecting to SOCKET from pre-forked workers\n");
+    printf("  --sample-profile FILE\n");
+    printf("                      sample the execution finger while running and\n");
+    printf("                      write the samples to FILE as folded stacks\n");
+    printf("  --snapshot SNAPSHOT write the machine to SNAPSHOT on SIGUSR1\n");
+    printf("  --snapshot-after N  write the snapshot after N instructions\n");
+    printf("  --stats             report instruction and system call counters\n");
+    printf("                      on exit\n");
+    printf("  --trace TRACE       write the last instructions executed to TRACE\n");
+    printf("                      on halt, failure or a fatal signal (TRACE=1\n");
+    printf("                      builds only)\n");
 }
 
 int
@@ -43,59 +172,581 @@ main(int argc, char* argv[])
 {
     // Parse command line arguments
     //
-    if ((argc != 2) && (argc != 3))
+    char* programName = NULL;
+    char* inputName = NULL;
+    bool memoryStats = false;
+    bool asyncIo = false;
+    bool hugePages = false;
+    bool machineStats = false;
+    bool profile = false;
+    char* snapshotName = NULL;
+    uint64_t snapshotAfter = 0;
+    char* restoreName = NULL;
+    char* traceName = NULL;
+    char* sampleName = NULL;
+    char* decodeTraceName = NULL;
+    bool batch = false;
+    bool forkAtInput = false;
+    uint64_t forkAfter = 0;
+    int forkMarker = -1;
+    char* serveName = NULL;
+    char* connectName = NULL;
+    int numJobs = 0;
+    int numBatchInputs = 0;
+    um32_machine_outputBuffering_t outputBuffering = isatty(1)
+        ? UM32_MACHINE_OUTPUT_LINE_BUFFERED
+        : UM32_MACHINE_OUTPUT_FULLY_BUFFERED;
+
+    for (int i=1; i<argc; i++)
     {
-        printf("Invalid number of arguments.\n");
+        if ((strcmp(argv[i], "-h") == 0) || (strcmp(argv[i], "--help") == 0))
+        {
+            printUsage();
+            return -1;
+        }
+        else if (strcmp(argv[i], "--async-io") == 0)
+        {
+            asyncIo = true;
+        }
+        else if (strcmp(argv[i], "--huge-pages") == 0)
+        {
+            hugePages = true;
+        }
+        else if (strcmp(argv[i], "--input") == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                printf("Missing input file.\n");
+                printUsage();
+                return -1;
+            }
+            inputName = argv[++i];
+        }
+        else if (strcmp(argv[i], "--memory-stats") == 0)
+        {
+            memoryStats = true;
+        }
+        else if (strcmp(argv[i], "--profile") == 0)
+        {
+            profile = true;
+        }
+        else if ((strcmp(argv[i], "--snapshot") == 0) ||
+                 (strcmp(argv[i], "--restore") == 0))
+        {
+            if (i + 1 >= argc)
+            {
+                printf("Missing snapshot file.\n");
+                printUsage();
+                return -1;
+            }
+            if (argv[i][2] == 's') { snapshotName = argv[++i]; }
+            else { restoreName = argv[++i]; }
+        }
+        else if (strcmp(argv[i], "--snapshot-after") == 0)
+        {
+            char* end_p = NULL;
+            if (i + 1 < argc)
+            {
+                snapshotAfter = strtoull(argv[i + 1], &end_p, 10);
+            }
+            if ((end_p == NULL) || (*end_p != '\0') || (snapshotAfter == 0))
+            {
+                printf("Invalid instruction count.\n");
+                printUsage();
+                return -1;
+            }
+            i++;
+        }
+        else if (strcmp(argv[i], "--stats") == 0)
+        {
+            machineStats = true;
+        }
+        else if (strcmp(argv[i], "--sample-profile") == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                printf("Missing sample profile file.\n");
+                printUsage();
+                return -1;
+            }
+            sampleName = argv[++i];
+        }
+        else if ((strcmp(argv[i], "--trace") == 0) ||
+                 (strcmp(argv[i], "--decode-trace") == 0))
+        {
+            if (i + 1 >= argc)
+            {
+                printf("Missing trace file.\n");
+                printUsage();
+                return -1;
+            }
+            if (argv[i][2] == 't') { traceName = argv[++i]; }
+            else { decodeTraceName = argv[++i]; }
+        }
+        else if (strcmp(argv[i], "--output-buffering") == 0)
+        {
+            if ((i + 1 < argc) && (strcmp(argv[i + 1], "line") == 0))
+            {
+                outputBuffering = UM32_MACHINE_OUTPUT_LINE_BUFFERED;
+            }
+            else if ((i + 1 < argc) && (strcmp(argv[i + 1], "full") == 0))
+            {
+                outputBuffering = UM32_MACHINE_OUTPUT_FULLY_BUFFERED;
+            }
+            else
+            {
+                printf("Invalid output buffering mode.\n");
+                printUsage();
+                return -1;
+            }
+            i++;
+        }
+        else if (strcmp(argv[i], "--batch") == 0)
+        {
+            batch = true;
+        }
+        else if (strcmp(argv[i], "--fork-at-input") == 0)
+        {
+            forkAtInput = true;
+        }
+        else if (strcmp(argv[i], "--fork-at-marker") == 0)
+        {
+            char* end_p = NULL;
+            unsigned long marker = 0;
+            if (i + 1 < argc)
+            {
+                marker = strtoul(argv[i + 1], &end_p, 0);
+            }
+            if ((end_p == NULL) || (end_p == argv[i + 1]) ||
+                (*end_p != '\0') || (marker > 255))
+            {
+                printf("Invalid fork marker.\n");
+                printUsage();
+                return -1;
+            }
+            forkMarker = (int)marker;
+            i++;
+        }
+        else if (strcmp(argv[i], "--fork-after") == 0)
+        {
+            char* end_p = NULL;
+            if (i + 1 < argc)
+            {
+                forkAfter = strtoull(argv[i + 1], &end_p, 10);
+            }
+            if ((end_p == NULL) || (*end_p != '\0') || (forkAfter == 0))
+            {
+                printf("Invalid instruction count.\n");
+                printUsage();
+                return -1;
+            }
+            i++;
+        }
+        else if ((strcmp(argv[i], "--serve") == 0) ||
+                 (strcmp(argv[i], "--connect") == 0))
+        {
+            if (i + 1 >= argc)
+            {
+                printf("Missing socket.\n");
+                printUsage();
+                return -1;
+            }
+            if (argv[i][2] == 's') { serveName = argv[++i]; }
+            else { connectName = argv[++i]; }
+        }
+        else if (strcmp(argv[i], "--jobs") == 0)
+        {
+            if ((i + 1 >= argc) || (atoi(argv[i + 1]) <= 0))
+            {
+                printf("Invalid number of jobs.\n");
+                printUsage();
+                return -1;
+            }
+            numJobs = atoi(argv[++i]);
+        }
+        else if (argv[i][0] == '-')
+        {
+            printf("Invalid arguments.\n");
+            printUsage();
+            return -1;
+        }
+        else if (programName != NULL)
+        {
+            // Further files are batch inputs; keep them at the front of argv
+            //
+            argv[numBatchInputs++] = argv[i];
+        }
+        else
+        {
+            programName = argv[i];
+        }
+    }
+
+    // Decoding a trace runs nothing
+    //
+    if (decodeTraceName != NULL)
+    {
+        if ((programName != NULL) || (restoreName != NULL) || batch ||
+            (serveName != NULL) || (connectName != NULL))
+        {
+            printf("Invalid arguments.\n");
+            printUsage();
+            return -1;
+        }
+
+        if (!um32_trace_print(decodeTraceName, stdout))
+        {
+            printf("Unable to read trace.\n");
+            return -1;
+        }
+        return 0;
+    }
+
+    // Batch mode runs every input through its own machine and nothing else
+    //
+    int numForkPoints = (forkAtInput ? 1 : 0) + ((forkAfter > 0) ? 1 : 0) +
+                        ((forkMarker != -1) ? 1 : 0);
+    bool forked = (numForkPoints > 0);
+    if (forked && !batch)
+    {
+        printf("Invalid arguments.\n");
         printUsage();
         return -1;
     }
 
-    if ((strcmp(argv[1], "-h") == 0) || (strcmp(argv[1], "--help") == 0))
+    if (batch)
+    {
+        if ((programName == NULL) || (numBatchInputs == 0) ||
+            (numForkPoints > 1) ||
+            ((inputName != NULL) && !forked) ||
+            ((forkMarker != -1) && (inputName == NULL)) ||
+            (restoreName != NULL) ||
+            (serveName != NULL) || (connectName != NULL) ||
+            (snapshotName != NULL) || (snapshotAfter > 0) || profile ||
+            (traceName != NULL) || (sampleName != NULL) || asyncIo ||
+            machineStats || memoryStats || hugePages)
+        {
+            printf("Invalid arguments.\n");
+            printUsage();
+            return -1;
+        }
+
+        if (numJobs == 0)
+        {
+            long numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+            numJobs = (numCpus > 0) ? (int)numCpus : 1;
+        }
+
+        // Forked batches run the shared prefix once and finish each input
+        // in a copy of the machine
+        //
+        int numFailed = forked
+            ? um32_batch_runForked(programName, inputName, forkAfter,
+                                   forkMarker, argv, numBatchInputs, numJobs)
+            : um32_batch_run(programName, argv, numBatchInputs, numJobs);
+
+        return (numFailed == 0) ? 0 : -1;
+    }
+
+    // Server mode loads every program given and serves runs of them until
+    // stopped
+    //
+    if (serveName != NULL)
+    {
+        if ((programName == NULL) || (connectName != NULL) ||
+            (inputName != NULL) || (restoreName != NULL) ||
+            (snapshotName != NULL) || (snapshotAfter > 0) || profile ||
+            (traceName != NULL) || (sampleName != NULL))
+        {
+            printf("Invalid arguments.\n");
+            printUsage();
+            return -1;
+        }
+
+        if (numJobs == 0)
+        {
+            long numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+            numJobs = (numCpus > 0) ? (int)numCpus : 1;
+        }
+
+        // Gather the programs at the front of argv, in command line order
+        //
+        memmove(&(argv[1]), &(argv[0]), (size_t)numBatchInputs * sizeof(char*));
+        argv[0] = programName;
+
+        return um32_server_serve(serveName, argv, numBatchInputs + 1, numJobs)
+            ? 0
+            : -1;
+    }
+
+    // A client hands its console to a server, which runs the program
+    //
+    if (connectName != NULL)
+    {
+        if ((programName == NULL) || (numBatchInputs > 0) ||
+            (restoreName != NULL) || (snapshotName != NULL) ||
+            (snapshotAfter > 0) || profile || (traceName != NULL) ||
+            (sampleName != NULL))
+        {
+            printf("Invalid arguments.\n");
+            printUsage();
+            return -1;
+        }
+
+        int inputFd = 0;
+        if ((inputName != NULL) && ((inputFd = open(inputName, O_RDONLY)) == -1))
+        {
+            printf("Unable to open input file.\n");
+            return -1;
+        }
+
+        uint32_t status = 0;
+        bool connected = um32_server_connect(connectName, programName, inputFd, 1,
+            (outputBuffering == UM32_MACHINE_OUTPUT_LINE_BUFFERED)
+                ? UM32_SERVER_LINE_BUFFERED
+                : 0,
+            &status);
+        if (inputFd != 0) { close(inputFd); }
+
+        if (!connected)
+        {
+            printf("Unable to reach server.\n");
+            return -1;
+        }
+        if (status == UM32_SERVER_UNKNOWN_PROGRAM)
+        {
+            printf("Unknown program.\n");
+            return -1;
+        }
+        return 0;
+    }
+
+    if (numBatchInputs > 0)
     {
+        printf("Invalid arguments.\n");
         printUsage();
         return -1;
     }
-    else if (argc == 3)
+
+    if ((programName == NULL) == (restoreName == NULL))
     {
         printf("Invalid number of arguments.\n");
         printUsage();
         return -1;
     }
 
-    // Open file stream of program
-    //
-    char* programName = argv[1];
-    FILE* file_p = fopen(programName, "r");
-    if (file_p  == NULL)
+    if ((snapshotAfter > 0) && (snapshotName == NULL))
     {
-        printf("Unable to open file.\n");
+        printf("Missing snapshot file.\n");
+        printUsage();
         return -1;
     }
 
-    // Run program using virtual machine
+    // Open scripted input, if any
     //
+    int inputFd = 0;
+    if (inputName != NULL)
+    {
+        inputFd = open(inputName, O_RDONLY);
+        if (inputFd == -1)
+        {
+            printf("Unable to open input file.\n");
+            return -1;
+        }
+    }
+
     um32_machine_pt machine_p = um32_machine_create();
     if (machine_p == NULL)
     {
         printf("Unable to create UM32 virtual machine.\n");
-        fclose(file_p);
+        if (inputFd != 0) { close(inputFd); }
         return -1;
     }
 
-    if (!um32_machine_init(machine_p, file_p))
+    // Load the program, or resume from a snapshot
+    //
+    if (restoreName != NULL)
     {
-        printf("Unable to initialize UM32 virtual machine.\n");
-        um32_machine_free(machine_p);
+        if (!um32_machine_restoreSnapshot(machine_p, restoreName))
+        {
+            printf("Unable to restore snapshot.\n");
+            um32_machine_free(machine_p);
+            if (inputFd != 0) { close(inputFd); }
+            return -1;
+        }
+    }
+    else
+    {
+        FILE* file_p = fopen(programName, "r");
+        if (file_p  == NULL)
+        {
+            printf("Unable to open file.\n");
+            um32_machine_free(machine_p);
+            if (inputFd != 0) { close(inputFd); }
+            return -1;
+        }
+
+        bool initialized = um32_machine_init(machine_p, file_p);
         fclose(file_p);
+        if (!initialized)
+        {
+            printf("Unable to initialize UM32 virtual machine.\n");
+            um32_machine_free(machine_p);
+            if (inputFd != 0) { close(inputFd); }
+            return -1;
+        }
+    }
+
+    machine_p->arrayTable.pool.hugePages = hugePages;
+
+    if (profile && !um32_machine_enableProfile(machine_p))
+    {
+        printf("Profiling is not supported by this build.\n");
+        um32_machine_free(machine_p);
+        if (inputFd != 0) { close(inputFd); }
         return -1;
     }
 
-    um32_machine_run(machine_p);
+    // The trace is also written if the process is killed or crashes, which is
+    // how a program indexing outside its arrays ends in unchecked builds
+    //
+    if (traceName != NULL)
+    {
+        if (!um32_machine_enableTrace(machine_p, traceName,
+                                      UM32_TRACE_DEFAULT_RECORDS))
+        {
+            printf("Tracing is not supported by this build.\n");
+            um32_machine_free(machine_p);
+            if (inputFd != 0) { close(inputFd); }
+            return -1;
+        }
+        um32_trace_saveOnSignal(machine_p->trace_p, traceName);
+    }
+
+    // SIGUSR1 asks for a snapshot. The handler is installed without
+    // SA_RESTART so that it also interrupts a wait for console input.
+    //
+    if (snapshotName != NULL)
+    {
+        um32_machine_setSnapshotFile(machine_p, snapshotName);
+
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = handleSnapshotSignal;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGUSR1, &action, NULL);
+    }
+
+    // SIGPROF samples the execution finger. The handler is installed with
+    // SA_RESTART so that samples never interrupt console I/O.
+    //
+    if (sampleName != NULL)
+    {
+        if (!um32_machine_enableSampling(machine_p))
+        {
+            printf("Unable to allocate sample profile.\n");
+            um32_machine_free(machine_p);
+            if (inputFd != 0) { close(inputFd); }
+            return -1;
+        }
+
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = handleSampleSignal;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGPROF, &action, NULL);
+        setSampleTimer(UM32_SAMPLER_DEFAULT_INTERVAL);
+    }
+
+    // Run program using virtual machine
+    //
+    um32_machine_setInput(machine_p, inputFd);
+    um32_machine_setOutputBuffering(machine_p, outputBuffering);
+
+    um32_console_pt console_p = NULL;
+    if (asyncIo)
+    {
+        console_p = um32_console_create(inputFd, 1,
+                                        UM32_CONSOLE_DEFAULT_RING_SIZE);
+        if (console_p == NULL)
+        {
+            printf("Unable to start console threads.\n");
+            um32_machine_free(machine_p);
+            if (inputFd != 0) { close(inputFd); }
+            return -1;
+        }
+        um32_console_attach(console_p, machine_p);
+    }
+
+    um32_machine_status_t status = UM32_MACHINE_STATUS_RUNNING;
+    if (snapshotAfter > 0)
+    {
+        status = um32_machine_runFor(machine_p, snapshotAfter);
+        if ((status == UM32_MACHINE_STATUS_RUNNING) &&
+            !um32_machine_saveSnapshot(machine_p, snapshotName))
+        {
+            printf("Unable to write snapshot.\n");
+        }
+    }
+
+    // A non-blocking console makes the machine return whenever input runs dry
+    // or output backs up, so wait for it before resuming. The I/O threads'
+    // console only returns to take a snapshot or sample, and waits itself.
+    //
+    while ((status == UM32_MACHINE_STATUS_RUNNING) ||
+           (status == UM32_MACHINE_STATUS_NEEDS_INPUT) ||
+           (status == UM32_MACHINE_STATUS_NEEDS_OUTPUT))
+    {
+        if ((console_p == NULL) &&
+            (status == UM32_MACHINE_STATUS_NEEDS_INPUT))
+        {
+            struct pollfd pollFd = { inputFd, POLLIN, 0 };
+            poll(&pollFd, 1, -1);
+        }
+        else if ((console_p == NULL) &&
+                 (status == UM32_MACHINE_STATUS_NEEDS_OUTPUT))
+        {
+            struct pollfd pollFd = { 1, POLLOUT, 0 };
+            poll(&pollFd, 1, -1);
+        }
+        status = um32_machine_run(machine_p);
+    }
+
+    if (machineStats)
+    {
+        printMachineStats(&(machine_p->stats));
+    }
+
+    if (sampleName != NULL)
+    {
+        setSampleTimer(0);
+        um32_sampler_print(machine_p->sampler_p, stderr);
+        if (!um32_sampler_save(machine_p->sampler_p, sampleName))
+        {
+            printf("Unable to write sample profile.\n");
+        }
+    }
+
+    if (profile)
+    {
+        um32_machine_printProfile(machine_p, stderr);
+    }
+
+    if (memoryStats)
+    {
+        printMemoryStats(&(machine_p->arrayTable.pool.stats),
+                         um32_array_table_residentBytes(&(machine_p->arrayTable)));
+    }
 
     // Free any allocated resources before exiting
     //
     um32_machine_free(machine_p);
-    fclose(file_p);
+    um32_console_free(console_p);
+    if (inputFd != 0) { close(inputFd); }
 
-    return 0;
+    // A failed machine, for instance one that divided by zero, fails the
+    // process so that scripts can tell it from a halt
+    //
+    return (status == UM32_MACHINE_STATUS_FAULT) ? -1 : 0;
 }
@@ -0,0 +1,122 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#include "um32_aot.h"
+
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+
+// Entry point of a translated program. Runs the image, which the translated
+// code was generated from, with the console on standard input and output.
+//
+int
+um32_aot_main(int argc, char* argv[], const uint32_t* image_a, uint32_t length,
+              um32_aot_program_t program)
+{
+    if (argc > 1)
+    {
+        printf("Usage: %s\n", argv[0]);
+        printf("Runs the translated program on standard input and output.\n");
+        return -1;
+    }
+
+    um32_array_storage_pt image_p = um32_array_storage_createShared(length);
+    if (image_p == NULL)
+    {
+        printf("Unable to allocate memory for program.\n");
+        return -1;
+    }
+    memcpy(image_p->platters_a, image_a, (size_t)length * sizeof(uint32_t));
+
+    um32_machine_pt machine_p = um32_machine_create();
+    if ((machine_p == NULL) || !um32_array_storage_decodeShared(image_p) ||
+        !um32_machine_initFromImage(machine_p, image_p))
+    {
+        printf("Unable to initialize UM32 virtual machine.\n");
+        um32_machine_free(machine_p);
+        um32_array_storage_freeShared(image_p);
+        return -1;
+    }
+
+    um32_machine_setOutputBuffering(machine_p, isatty(1)
+        ? UM32_MACHINE_OUTPUT_LINE_BUFFERED
+        : UM32_MACHINE_OUTPUT_FULLY_BUFFERED);
+
+    // The translated code runs until the program does something only the
+    // interpreter can, and the interpreter takes over for good
+    //
+    bool translated = true;
+    um32_machine_status_t status = UM32_MACHINE_STATUS_RUNNING;
+    while ((status == UM32_MACHINE_STATUS_RUNNING) ||
+           (status == UM32_MACHINE_STATUS_NEEDS_INPUT) ||
+           (status == UM32_MACHINE_STATUS_NEEDS_OUTPUT))
+    {
+        if (status == UM32_MACHINE_STATUS_NEEDS_INPUT)
+        {
+            struct pollfd pollFd = { machine_p->inputFd, POLLIN, 0 };
+            poll(&pollFd, 1, -1);
+        }
+        else if (status == UM32_MACHINE_STATUS_NEEDS_OUTPUT)
+        {
+            struct pollfd pollFd = { machine_p->outputFd, POLLOUT, 0 };
+            poll(&pollFd, 1, -1);
+        }
+
+        // Output the console would not take last time goes first, and a
+        // machine that stopped for good is only waiting for it
+        //
+        if (translated)
+        {
+            if (!um32_machine_flushOutput(machine_p)) { continue; }
+            if ((machine_p->status == UM32_MACHINE_STATUS_HALTED) ||
+                (machine_p->status == UM32_MACHINE_STATUS_FAULT))
+            {
+                status = machine_p->status;
+                continue;
+            }
+
+            machine_p->status = UM32_MACHINE_STATUS_RUNNING;
+            translated = program(machine_p);
+            status = um32_machine_flushOutput(machine_p)
+                ? machine_p->status
+                : UM32_MACHINE_STATUS_NEEDS_OUTPUT;
+        }
+        else
+        {
+            status = um32_machine_run(machine_p);
+        }
+    }
+
+    um32_machine_free(machine_p);
+    um32_array_storage_freeShared(image_p);
+
+    // A failed machine fails the process, as with um32.out
+    //
+    return (status == UM32_MACHINE_STATUS_FAULT) ? -1 : 0;
+}
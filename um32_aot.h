@@ -0,0 +1,169 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#ifndef UM32_AOT_H
+#define UM32_AOT_H
+
+#include "um32_array.h"
+#include "um32_machine.h"
+#include "um32_platter.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Runtime for programs translated to C by um32_aot. A translated program is a
+// single function holding one labelled block per offset of the '0' array,
+// working on the registers in locals. Load Program from the '0' array jumps
+// through a switch over every offset. The function returns true when the
+// machine stops (halts, fails or needs input it does not have yet), and false
+// when the program loads another array as its program or amends its own code.
+// From then on the interpreter runs the machine.
+//
+typedef bool (*um32_aot_program_t)(um32_machine_pt machine_p);
+
+int um32_aot_main(int argc, char* argv[], const uint32_t* image_a,
+                  uint32_t length, um32_aot_program_t program);
+
+//  Translated code.
+//  ----------------
+//
+//  The macros below are the building blocks emitted by um32_aot. They expect
+//  machine_p, reg_a and offset in scope and a label named dispatch.
+//
+
+#define UM32_AOT_SAVE_STATE(next)                                              \
+    do                                                                         \
+    {                                                                          \
+        for (int i=0; i<UM32_NUM_GENERAL_PURPOSE_REGISTERS; i++)               \
+        {                                                                      \
+            machine_p->reg_a[i] = um32_platter_fromUInt32(reg_a[i]);           \
+        }                                                                      \
+        machine_p->executionFinger_p = machine_p->zeroArray_p + (next);        \
+    } while (0)
+
+#define UM32_AOT_LOAD_STATE()                                                  \
+    do                                                                         \
+    {                                                                          \
+        for (int i=0; i<UM32_NUM_GENERAL_PURPOSE_REGISTERS; i++)               \
+        {                                                                      \
+            reg_a[i] = um32_platter_toUInt32(machine_p->reg_a[i]);             \
+        }                                                                      \
+    } while (0)
+
+#define UM32_AOT_PROLOGUE()                                                    \
+    uint32_t reg_a[UM32_NUM_GENERAL_PURPOSE_REGISTERS];                        \
+    uint32_t offset = (uint32_t)(machine_p->executionFinger_p -                \
+                                 machine_p->zeroArray_p);                      \
+    UM32_AOT_LOAD_STATE();                                                     \
+    goto dispatch
+
+// Stops the machine with the given status, the finger resting on next
+//
+#define UM32_AOT_STOP(next, machineStatus)                                     \
+    do                                                                         \
+    {                                                                          \
+        UM32_AOT_SAVE_STATE(next);                                             \
+        machine_p->status = (machineStatus);                                   \
+        return true;                                                           \
+    } while (0)
+
+// Leaves the instruction at cur, and everything after it, to the interpreter
+//
+#define UM32_AOT_FALL_BACK(cur)                                                \
+    do                                                                         \
+    {                                                                          \
+        UM32_AOT_SAVE_STATE(cur);                                              \
+        return false;                                                          \
+    } while (0)
+
+// Has the interpreter discharge the instruction at cur and carries on
+//
+#define UM32_AOT_INTERPRET(cur)                                                \
+    do                                                                         \
+    {                                                                          \
+        UM32_AOT_SAVE_STATE(cur);                                              \
+        if (!um32_machine_discharge(machine_p)) { return true; }               \
+        UM32_AOT_LOAD_STATE();                                                 \
+    } while (0)
+
+#define UM32_AOT_CONDITIONAL_MOVE(a, b, c)                                     \
+    if (reg_a[c] != 0) { reg_a[a] = reg_a[b]; }
+
+#define UM32_AOT_ARRAY_INDEX(a, b, c)                                          \
+    reg_a[a] = um32_platter_toUInt32(um32_array_table_get(                     \
+        &(machine_p->arrayTable), reg_a[b])->platters_p[reg_a[c]]);
+
+#define UM32_AOT_ARRAY_AMENDMENT(cur, a, b, c)                                 \
+    if (reg_a[a] == 0) { UM32_AOT_FALL_BACK(cur); }                            \
+    if (!um32_array_table_amend(&(machine_p->arrayTable), reg_a[a], reg_a[b],  \
+                                um32_platter_fromUInt32(reg_a[c])))            \
+    {                                                                          \
+        printf("Unable to allocate memory for amended array.\n");              \
+    }
+
+#define UM32_AOT_ADDITION(a, b, c)                                             \
+    reg_a[a] = reg_a[b] + reg_a[c];
+
+#define UM32_AOT_MULTIPLICATION(a, b, c)                                       \
+    reg_a[a] = reg_a[b] * reg_a[c];
+
+#define UM32_AOT_DIVISION(cur, a, b, c)                                        \
+    if (reg_a[c] == 0) { UM32_AOT_STOP((cur) + 1, UM32_MACHINE_STATUS_FAULT); } \
+    reg_a[a] = reg_a[b] / reg_a[c];
+
+#define UM32_AOT_NOT_AND(a, b, c)                                              \
+    reg_a[a] = ~(reg_a[b] & reg_a[c]);
+
+#define UM32_AOT_HALT(cur)                                                     \
+    UM32_AOT_STOP((cur) + 1, UM32_MACHINE_STATUS_HALTED);
+
+#define UM32_AOT_ALLOCATION(b, c)                                              \
+    {                                                                          \
+        uint32_t id = um32_array_table_allocate(&(machine_p->arrayTable),      \
+                                                reg_a[c]);                     \
+        if (id == 0) { printf("Unable to allocate array of platters.\n"); }    \
+        else { reg_a[b] = id; }                                                \
+    }
+
+#define UM32_AOT_ABANDONMENT(c)                                                \
+    um32_array_table_abandon(&(machine_p->arrayTable), reg_a[c]);
+
+#define UM32_AOT_LOAD_PROGRAM(cur, b, c)                                       \
+    if (reg_a[b] != 0) { UM32_AOT_FALL_BACK(cur); }                            \
+    offset = reg_a[c];                                                         \
+    goto dispatch;
+
+#define UM32_AOT_ORTHOGRAPHY(a, value)                                         \
+    reg_a[a] = (value);
+
+// Running off the end of the '0' array fails the machine
+//
+#define UM32_AOT_END(length)                                                   \
+    UM32_AOT_STOP(length, UM32_MACHINE_STATUS_FAULT);
+
+#endif /* UM32_AOT_H */
@@ -0,0 +1,680 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#include "um32_array.h"
+
+#include "um32_memory.h"
+#include <stdio.h>
+#include <string.h>
+
+#define UM32_ARRAY_TABLE_INITIAL_CAPACITY 1024
+
+//  Storage.
+//  --------
+//
+
+// Returns the number of bytes of storage holding length platters
+//
+static inline size_t
+um32_array_storage_size(uint32_t length)
+{
+    return sizeof(um32_array_storage_t) + (size_t)length * sizeof(um32_platter_t);
+}
+
+// Allocates storage for length platters, leaving the platters uninitialized
+//
+static um32_array_storage_pt
+um32_array_storage_alloc(um32_memory_pool_pt pool_p, uint32_t length)
+{
+    um32_array_storage_pt storage_p = (um32_array_storage_pt)
+        um32_memory_pool_alloc(pool_p, um32_array_storage_size(length));
+    if (storage_p == NULL) { return NULL; }
+
+    storage_p->decoded_p = NULL;
+    storage_p->refCount = 1;
+    storage_p->length = length;
+
+    return storage_p;
+}
+
+// Allocates storage for length platters, all holding the value 0. Large
+// storage is mapped from the kernel already zeroed, and is left untouched so
+// that its pages are only made resident as the program writes to them.
+//
+static um32_array_storage_pt
+um32_array_storage_create(um32_memory_pool_pt pool_p, uint32_t length)
+{
+    um32_array_storage_pt storage_p = um32_array_storage_alloc(pool_p, length);
+    if (storage_p == NULL) { return NULL; }
+
+    if (!um32_memory_pool_isMapped(um32_array_storage_size(length)))
+    {
+        memset(storage_p->platters_a, 0,
+               (size_t)length * sizeof(um32_platter_t));
+    }
+
+    return storage_p;
+}
+
+// Drops one reference to the storage, freeing it with the last one
+//
+static void
+um32_array_storage_release(um32_memory_pool_pt pool_p,
+                           um32_array_storage_pt storage_p)
+{
+    if ((storage_p->refCount == UM32_ARRAY_STORAGE_SHARED) ||
+        (--storage_p->refCount > 0))
+    {
+        return;
+    }
+
+    um32_memory_free(storage_p->decoded_p);
+    um32_memory_pool_dealloc(pool_p, storage_p,
+                             um32_array_storage_size(storage_p->length));
+}
+
+//  Table.
+//  ------
+//
+
+// Grows the table so that it can hold at least one more identifier
+//
+static bool
+um32_array_table_grow(um32_array_table_pt table_p)
+{
+    if (table_p->capacity == UINT32_MAX) { return false; }
+
+    uint32_t newCapacity = (table_p->capacity > (UINT32_MAX / 2))
+                         ? UINT32_MAX
+                         : (table_p->capacity * 2);
+
+    um32_array_pt arrays_p =
+        (um32_array_pt)um32_memory_realloc(table_p->arrays_p,
+                                           newCapacity * sizeof(um32_array_t));
+    if (arrays_p == NULL) { return false; }
+    table_p->arrays_p = arrays_p;
+
+    // Every abandoned identifier is below numArrays, so the free identifier
+    // stack never needs to be larger than the table itself
+    //
+    uint32_t* freeIds_p =
+        (uint32_t*)um32_memory_realloc(table_p->freeIds_p,
+                                       newCapacity * sizeof(uint32_t));
+    if (freeIds_p == NULL) { return false; }
+    table_p->freeIds_p = freeIds_p;
+
+    table_p->capacity = newCapacity;
+
+    return true;
+}
+
+// Points the array identified by id at storage_p, which must hold length
+// platters
+//
+static inline void
+um32_array_table_set(um32_array_table_pt table_p, uint32_t id,
+                     um32_array_storage_pt storage_p, uint32_t length)
+{
+    table_p->arrays_p[id].platters_p = storage_p->platters_a;
+    table_p->arrays_p[id].length = length;
+}
+
+bool
+um32_array_table_init(um32_array_table_pt table_p)
+{
+    if (table_p == NULL) { return false; }
+
+    memset(table_p, 0, sizeof(um32_array_table_t));
+    um32_memory_pool_init(&(table_p->pool));
+
+    table_p->arrays_p = (um32_array_pt)um32_memory_malloc(
+        UM32_ARRAY_TABLE_INITIAL_CAPACITY * sizeof(um32_array_t));
+    table_p->freeIds_p = (uint32_t*)um32_memory_malloc(
+        UM32_ARRAY_TABLE_INITIAL_CAPACITY * sizeof(uint32_t));
+    if ((table_p->arrays_p == NULL) || (table_p->freeIds_p == NULL))
+    {
+        um32_array_table_free(table_p);
+        return false;
+    }
+    table_p->capacity = UM32_ARRAY_TABLE_INITIAL_CAPACITY;
+
+    // Identifier 0 is reserved for the '0' array, which is loaded separately
+    //
+    table_p->arrays_p[0].platters_p = NULL;
+    table_p->arrays_p[0].length = 0;
+    table_p->numArrays = 1;
+
+    return true;
+}
+
+void
+um32_array_table_free(um32_array_table_pt table_p)
+{
+    if (table_p == NULL) { return; }
+
+    // Release every array still active, including the '0' array
+    //
+    if (table_p->arrays_p != NULL)
+    {
+        for (uint32_t id=0; id<table_p->numArrays; id++)
+        {
+            um32_platter_pt platters_p = table_p->arrays_p[id].platters_p;
+            if (platters_p == NULL) { continue; }
+
+            um32_array_storage_release(&(table_p->pool),
+                um32_array_storage_fromPlatters(platters_p));
+        }
+    }
+
+    um32_memory_free(table_p->arrays_p);
+    um32_memory_free(table_p->freeIds_p);
+    um32_memory_pool_free(&(table_p->pool));
+    memset(table_p, 0, sizeof(um32_array_table_t));
+}
+
+// Allocates a zeroed array of length platters and returns its identifier, or 0
+// if the array could not be allocated
+//
+uint32_t
+um32_array_table_allocate(um32_array_table_pt table_p, uint32_t length)
+{
+    um32_array_storage_pt storage_p =
+        um32_array_storage_create(&(table_p->pool), length);
+    if (storage_p == NULL) { return 0; }
+
+    // Reuse the most recently abandoned identifier if there is one
+    //
+    uint32_t id;
+    if (table_p->numFreeIds > 0)
+    {
+        id = table_p->freeIds_p[--table_p->numFreeIds];
+    }
+    else
+    {
+        if ((table_p->numArrays == table_p->capacity) &&
+            !um32_array_table_grow(table_p))
+        {
+            um32_array_storage_release(&(table_p->pool), storage_p);
+            return 0;
+        }
+        id = table_p->numArrays++;
+    }
+
+    um32_array_table_set(table_p, id, storage_p, length);
+
+    return id;
+}
+
+// Releases the array identified by id and makes the identifier available to
+// future allocations
+//
+void
+um32_array_table_abandon(um32_array_table_pt table_p, uint32_t id)
+{
+    // Abandoning the '0' array or an inactive array is ignored, otherwise the
+    // same identifier could end up on the free stack twice
+    //
+    if ((id == 0) || (id >= table_p->numArrays) ||
+        (table_p->arrays_p[id].platters_p == NULL))
+    {
+        return;
+    }
+
+    um32_array_storage_release(&(table_p->pool),
+        um32_array_storage_fromPlatters(table_p->arrays_p[id].platters_p));
+    table_p->arrays_p[id].platters_p = NULL;
+    table_p->arrays_p[id].length = 0;
+
+    table_p->freeIds_p[table_p->numFreeIds++] = id;
+}
+
+// Replaces the contents of the array identified by id with length platters
+// holding the value 0
+//
+bool
+um32_array_table_replace(um32_array_table_pt table_p, uint32_t id,
+                         uint32_t length)
+{
+    um32_array_storage_pt storage_p =
+        um32_array_storage_create(&(table_p->pool), length);
+    if (storage_p == NULL) { return false; }
+
+    um32_platter_pt platters_p = table_p->arrays_p[id].platters_p;
+    if (platters_p != NULL)
+    {
+        um32_array_storage_release(&(table_p->pool),
+                                   um32_array_storage_fromPlatters(platters_p));
+    }
+    um32_array_table_set(table_p, id, storage_p, length);
+
+    return true;
+}
+
+// Makes the array identified by dstId share the storage of the array
+// identified by srcId. Neither array is copied until one of them is amended.
+//
+void
+um32_array_table_share(um32_array_table_pt table_p, uint32_t dstId,
+                       uint32_t srcId)
+{
+    um32_array_pt srcArray_p = um32_array_table_get(table_p, srcId);
+    um32_array_pt dstArray_p = um32_array_table_get(table_p, dstId);
+    if (srcArray_p->platters_p == dstArray_p->platters_p) { return; }
+
+    um32_array_storage_pt storage_p =
+        um32_array_storage_fromPlatters(srcArray_p->platters_p);
+    if (storage_p->refCount != UM32_ARRAY_STORAGE_SHARED) { storage_p->refCount++; }
+    if (dstArray_p->platters_p != NULL)
+    {
+        um32_array_storage_release(&(table_p->pool),
+            um32_array_storage_fromPlatters(dstArray_p->platters_p));
+    }
+
+    dstArray_p->platters_p = srcArray_p->platters_p;
+    dstArray_p->length = srcArray_p->length;
+}
+
+// Makes the array identified by id use storage created by
+// um32_array_storage_createShared. It is copied on the first amendment.
+//
+void
+um32_array_table_attach(um32_array_table_pt table_p, uint32_t id,
+                        um32_array_storage_pt storage_p)
+{
+    um32_platter_pt platters_p = table_p->arrays_p[id].platters_p;
+    if (platters_p != NULL)
+    {
+        um32_array_storage_release(&(table_p->pool),
+                                   um32_array_storage_fromPlatters(platters_p));
+    }
+    um32_array_table_set(table_p, id, storage_p, storage_p->length);
+}
+
+// Returns how many bytes of the active arrays mapped from the kernel are
+// resident in memory. Storage shared by the '0' array and another array is
+// counted once.
+//
+uint64_t
+um32_array_table_residentBytes(um32_array_table_pt table_p)
+{
+    um32_platter_pt program_p =
+        (table_p->numArrays > 0) ? table_p->arrays_p[0].platters_p : NULL;
+
+    uint64_t resident = 0;
+    for (uint32_t id=0; id<table_p->numArrays; id++)
+    {
+        um32_platter_pt platters_p = table_p->arrays_p[id].platters_p;
+        if ((platters_p == NULL) || ((id != 0) && (platters_p == program_p)))
+        {
+            continue;
+        }
+
+        um32_array_storage_pt storage_p =
+            um32_array_storage_fromPlatters(platters_p);
+        size_t size = um32_array_storage_size(storage_p->length);
+        if ((storage_p->refCount == UM32_ARRAY_STORAGE_SHARED) ||
+            !um32_memory_pool_isMapped(size))
+        {
+            continue;
+        }
+
+        resident += um32_memory_residentBytes(storage_p, size);
+    }
+
+    return resident;
+}
+
+// Allocates storage for length platters outside of any table, for tables to
+// share with um32_array_table_attach. The platters are left uninitialized and
+// must be filled in, and decoded with um32_array_storage_decodeShared, before
+// the storage is attached.
+//
+um32_array_storage_pt
+um32_array_storage_createShared(uint32_t length)
+{
+    um32_array_storage_pt storage_p = (um32_array_storage_pt)
+        um32_memory_malloc(um32_array_storage_size(length));
+    if (storage_p == NULL) { return NULL; }
+
+    storage_p->decoded_p = NULL;
+    storage_p->refCount = UM32_ARRAY_STORAGE_SHARED;
+    storage_p->length = length;
+
+    return storage_p;
+}
+
+bool
+um32_array_storage_decodeShared(um32_array_storage_pt storage_p)
+{
+    if (storage_p->decoded_p != NULL) { return true; }
+
+    storage_p->decoded_p = (um32_instruction_pt)um32_memory_malloc(
+        ((size_t)storage_p->length + 1) * sizeof(um32_instruction_t));
+    if (storage_p->decoded_p == NULL) { return false; }
+
+    um32_instruction_decodeArray(storage_p->decoded_p, storage_p->platters_a,
+                                 storage_p->length);
+
+    return true;
+}
+
+// Frees storage created by um32_array_storage_createShared once no table uses
+// it any more
+//
+void
+um32_array_storage_freeShared(um32_array_storage_pt storage_p)
+{
+    if (storage_p == NULL) { return; }
+
+    um32_memory_free(storage_p->decoded_p);
+    um32_memory_free(storage_p);
+}
+
+// Returns the decoded form of the array identified by id, decoding it the first
+// time its storage is loaded as a program. Returns NULL if there is not enough
+// memory.
+//
+um32_instruction_pt
+um32_array_table_decode(um32_array_table_pt table_p, uint32_t id)
+{
+    um32_array_pt array_p = um32_array_table_get(table_p, id);
+    um32_array_storage_pt storage_p =
+        um32_array_storage_fromPlatters(array_p->platters_p);
+    if (storage_p->decoded_p != NULL) { return storage_p->decoded_p; }
+
+    um32_instruction_pt decoded_p = (um32_instruction_pt)um32_memory_malloc(
+        ((size_t)array_p->length + 1) * sizeof(um32_instruction_t));
+    if (decoded_p == NULL) { return NULL; }
+
+    um32_instruction_decodeArray(decoded_p, array_p->platters_p,
+                                 array_p->length);
+    storage_p->decoded_p = decoded_p;
+
+    return decoded_p;
+}
+
+// Slow path of um32_array_table_amend. Gives the array its own copy of shared
+// storage before writing, and keeps any decoded form in sync.
+//
+bool
+um32_array_table_amendShared(um32_array_table_pt table_p, uint32_t id,
+                             uint32_t offset, um32_platter_t platter)
+{
+    um32_array_pt array_p = um32_array_table_get(table_p, id);
+    um32_array_storage_pt storage_p =
+        um32_array_storage_fromPlatters(array_p->platters_p);
+
+    if (storage_p->refCount > 1)
+    {
+        um32_array_storage_pt copy_p =
+            um32_array_storage_alloc(&(table_p->pool), array_p->length);
+        if (copy_p == NULL) { return false; }
+        memcpy(copy_p->platters_a, array_p->platters_p,
+               (size_t)array_p->length * sizeof(um32_platter_t));
+
+        // Carry the decoded form over so a program keeps running from it
+        //
+        if (storage_p->decoded_p != NULL)
+        {
+            size_t decodedSize =
+                ((size_t)array_p->length + 1) * sizeof(um32_instruction_t);
+            copy_p->decoded_p =
+                (um32_instruction_pt)um32_memory_malloc(decodedSize);
+            if (copy_p->decoded_p == NULL)
+            {
+                um32_array_storage_release(&(table_p->pool), copy_p);
+                return false;
+            }
+            memcpy(copy_p->decoded_p, storage_p->decoded_p, decodedSize);
+        }
+
+        um32_array_storage_release(&(table_p->pool), storage_p);
+        um32_array_table_set(table_p, id, copy_p, array_p->length);
+        storage_p = copy_p;
+    }
+
+    array_p->platters_p[offset] = platter;
+    if ((storage_p->decoded_p != NULL) && (offset < array_p->length))
+    {
+        storage_p->decoded_p[offset] = um32_instruction_decode(platter);
+        um32_instruction_fuse(storage_p->decoded_p, offset);
+        if (offset > 0)
+        {
+            um32_instruction_fuse(storage_p->decoded_p, offset - 1);
+        }
+    }
+
+    return true;
+}
+
+//  Snapshots.
+//  ----------
+//
+//  A saved table is the number of identifiers and of free identifiers, the
+//  free identifier stack, and then one record per identifier in order. Arrays
+//  sharing storage are written once: later sharers only name the first
+//  identifier that used it. Decoded forms are not saved. Everything is stored
+//  in host byte order.
+//
+
+#define UM32_ARRAY_RECORD_INACTIVE  0
+#define UM32_ARRAY_RECORD_OWNED     1
+#define UM32_ARRAY_RECORD_SHARED    2
+
+typedef struct
+{
+    uint32_t  state;
+    uint32_t  length;
+    uint32_t  sharedId;
+} um32_array_record_t;
+
+typedef struct
+{
+    uint32_t  numArrays;
+    uint32_t  numFreeIds;
+} um32_array_tableHeader_t;
+
+// Open-addressed map from shared storage to the first identifier saved with it
+//
+typedef struct
+{
+    um32_array_storage_pt  storage_p;
+    uint32_t               id;
+} um32_array_sharedEntry_t;
+
+static size_t
+um32_array_sharedSlot(um32_array_storage_pt storage_p, size_t mask)
+{
+    return (size_t)(((uintptr_t)storage_p >> 4) * 2654435761u) & mask;
+}
+
+// Writes the table to file_p. Returns false if the file could not be written.
+//
+bool
+um32_array_table_save(um32_array_table_pt table_p, FILE* file_p)
+{
+    um32_array_tableHeader_t header = { table_p->numArrays, table_p->numFreeIds };
+    if ((fwrite(&header, sizeof(header), 1, file_p) != 1) ||
+        (fwrite(table_p->freeIds_p, sizeof(uint32_t), table_p->numFreeIds,
+                file_p) != table_p->numFreeIds))
+    {
+        return false;
+    }
+
+    // Size the map of shared storage for every array that may be a sharer
+    //
+    size_t numShared = 0;
+    for (uint32_t id=0; id<table_p->numArrays; id++)
+    {
+        um32_platter_pt platters_p = table_p->arrays_p[id].platters_p;
+        if ((platters_p != NULL) &&
+            (um32_array_storage_fromPlatters(platters_p)->refCount > 1))
+        {
+            numShared++;
+        }
+    }
+
+    size_t mapSize = 16;
+    while (mapSize < numShared * 2) { mapSize *= 2; }
+    um32_array_sharedEntry_t* map_p = (um32_array_sharedEntry_t*)
+        um32_memory_malloc(mapSize * sizeof(um32_array_sharedEntry_t));
+    if (map_p == NULL) { return false; }
+    memset(map_p, 0, mapSize * sizeof(um32_array_sharedEntry_t));
+
+    bool result = true;
+    for (uint32_t id=0; result && (id<table_p->numArrays); id++)
+    {
+        um32_array_pt array_p = um32_array_table_get(table_p, id);
+        um32_array_record_t record = { UM32_ARRAY_RECORD_INACTIVE, 0, 0 };
+
+        if (array_p->platters_p != NULL)
+        {
+            um32_array_storage_pt storage_p =
+                um32_array_storage_fromPlatters(array_p->platters_p);
+            record.state = UM32_ARRAY_RECORD_OWNED;
+            record.length = array_p->length;
+
+            if (storage_p->refCount > 1)
+            {
+                size_t slot = um32_array_sharedSlot(storage_p, mapSize - 1);
+                while ((map_p[slot].storage_p != NULL) &&
+                       (map_p[slot].storage_p != storage_p))
+                {
+                    slot = (slot + 1) & (mapSize - 1);
+                }
+
+                if (map_p[slot].storage_p == storage_p)
+                {
+                    record.state = UM32_ARRAY_RECORD_SHARED;
+                    record.sharedId = map_p[slot].id;
+                }
+                else
+                {
+                    map_p[slot].storage_p = storage_p;
+                    map_p[slot].id = id;
+                }
+            }
+        }
+
+        result = (fwrite(&record, sizeof(record), 1, file_p) == 1);
+        if (result && (record.state == UM32_ARRAY_RECORD_OWNED))
+        {
+            result = (fwrite(array_p->platters_p, sizeof(um32_platter_t),
+                             record.length, file_p) == record.length);
+        }
+    }
+
+    um32_memory_free(map_p);
+
+    return result;
+}
+
+// Reads a table written by um32_array_table_save from the buffer at *cur_pp,
+// advancing it past the table. The table must have just been initialized.
+// Returns false if the buffer does not hold a valid table or there is not
+// enough memory, in which case the table still has to be freed.
+//
+bool
+um32_array_table_load(um32_array_table_pt table_p, const char** cur_pp,
+                      const char* end_p)
+{
+    const char* cur_p = *cur_pp;
+
+    um32_array_tableHeader_t header;
+    if ((size_t)(end_p - cur_p) < sizeof(header)) { return false; }
+    memcpy(&header, cur_p, sizeof(header));
+    cur_p += sizeof(header);
+
+    if ((header.numArrays == 0) || (header.numFreeIds >= header.numArrays) ||
+        ((size_t)(end_p - cur_p) / sizeof(uint32_t) < header.numFreeIds))
+    {
+        return false;
+    }
+
+    while (table_p->capacity < header.numArrays)
+    {
+        if (!um32_array_table_grow(table_p)) { return false; }
+    }
+    memset(table_p->arrays_p, 0, (size_t)header.numArrays * sizeof(um32_array_t));
+    table_p->numArrays = header.numArrays;
+
+    memcpy(table_p->freeIds_p, cur_p, (size_t)header.numFreeIds * sizeof(uint32_t));
+    cur_p += (size_t)header.numFreeIds * sizeof(uint32_t);
+
+    for (uint32_t id=0; id<header.numArrays; id++)
+    {
+        um32_array_record_t record;
+        if ((size_t)(end_p - cur_p) < sizeof(record)) { return false; }
+        memcpy(&record, cur_p, sizeof(record));
+        cur_p += sizeof(record);
+
+        if (record.state == UM32_ARRAY_RECORD_OWNED)
+        {
+            size_t size = (size_t)record.length * sizeof(um32_platter_t);
+            if ((size_t)(end_p - cur_p) < size) { return false; }
+
+            um32_array_storage_pt storage_p =
+                um32_array_storage_alloc(&(table_p->pool), record.length);
+            if (storage_p == NULL) { return false; }
+            memcpy(storage_p->platters_a, cur_p, size);
+            cur_p += size;
+
+            um32_array_table_set(table_p, id, storage_p, record.length);
+        }
+        else if (record.state == UM32_ARRAY_RECORD_SHARED)
+        {
+            if ((record.sharedId >= id) ||
+                (table_p->arrays_p[record.sharedId].platters_p == NULL))
+            {
+                return false;
+            }
+            um32_array_table_share(table_p, id, record.sharedId);
+        }
+        else if (record.state != UM32_ARRAY_RECORD_INACTIVE)
+        {
+            return false;
+        }
+    }
+
+    // Only abandoned identifiers other than 0 may be handed out again
+    //
+    for (uint32_t i=0; i<header.numFreeIds; i++)
+    {
+        uint32_t id = table_p->freeIds_p[i];
+        if ((id == 0) || (id >= header.numArrays) ||
+            (table_p->arrays_p[id].platters_p != NULL))
+        {
+            return false;
+        }
+    }
+    table_p->numFreeIds = header.numFreeIds;
+
+    *cur_pp = cur_p;
+
+    return true;
+}
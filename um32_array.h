@@ -0,0 +1,180 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#ifndef UM32_ARRAY_H
+#define UM32_ARRAY_H
+
+#include "um32_instruction.h"
+#include "um32_memory.h"
+#include "um32_platter.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Storage backing one or more arrays of platters. Load Program makes the '0'
+// array share the storage of the array being loaded instead of copying it, so
+// storage is reference counted and copied on the first write made while it is
+// shared. Storage that has been loaded as a program also carries the decoded
+// form of its platters, which is kept in sync with every write.
+//
+// Storage whose reference count is UM32_ARRAY_STORAGE_SHARED belongs to no
+// table. It is created with um32_array_storage_createShared, already decoded,
+// and may be used by tables on several threads at once: they never count
+// references to it, never write to it and never free it.
+//
+#define UM32_ARRAY_STORAGE_SHARED UINT32_MAX
+
+typedef struct
+{
+    um32_instruction_pt  decoded_p;
+    uint32_t             refCount;
+    uint32_t             length;
+    um32_platter_t       platters_a[];
+} um32_array_storage_t;
+typedef um32_array_storage_t* um32_array_storage_pt;
+
+// Structure representing an array of platters. The specifications follows:
+//
+//    * A collection of arrays of platters, each referenced by a distinct
+//      32-bit identifier. One distinguished array is referenced by 0
+//      and stores the "program." This array will be referred to as the
+//      '0' array.
+//
+typedef struct
+{
+    um32_platter_pt  platters_p;
+    uint32_t         length;
+} um32_array_t;
+typedef um32_array_t* um32_array_pt;
+
+// Structure mapping 32-bit array identifiers to arrays of platters. Identifiers
+// are dense indices into arrays_p so that they fit in a platter regardless of
+// the width of a host pointer. Abandoned identifiers are pushed onto the
+// freeIds_p stack and handed out again by later allocations. Storage comes
+// from the table's own size-class pool.
+//
+typedef struct
+{
+    um32_array_pt       arrays_p;
+    uint32_t            numArrays;
+    uint32_t            capacity;
+    uint32_t*           freeIds_p;
+    uint32_t            numFreeIds;
+    um32_memory_pool_t  pool;
+} um32_array_table_t;
+typedef um32_array_table_t* um32_array_table_pt;
+
+bool um32_array_table_init(um32_array_table_pt table_p);
+void um32_array_table_free(um32_array_table_pt table_p);
+uint32_t um32_array_table_allocate(um32_array_table_pt table_p,
+                                   uint32_t length);
+void um32_array_table_abandon(um32_array_table_pt table_p, uint32_t id);
+bool um32_array_table_replace(um32_array_table_pt table_p, uint32_t id,
+                              uint32_t length);
+void um32_array_table_share(um32_array_table_pt table_p, uint32_t dstId,
+                            uint32_t srcId);
+um32_instruction_pt um32_array_table_decode(um32_array_table_pt table_p,
+                                            uint32_t id);
+bool um32_array_table_amendShared(um32_array_table_pt table_p, uint32_t id,
+                                  uint32_t offset, um32_platter_t platter);
+void um32_array_table_attach(um32_array_table_pt table_p, uint32_t id,
+                             um32_array_storage_pt storage_p);
+uint64_t um32_array_table_residentBytes(um32_array_table_pt table_p);
+um32_array_storage_pt um32_array_storage_createShared(uint32_t length);
+bool um32_array_storage_decodeShared(um32_array_storage_pt storage_p);
+void um32_array_storage_freeShared(um32_array_storage_pt storage_p);
+bool um32_array_table_save(um32_array_table_pt table_p, FILE* file_p);
+bool um32_array_table_load(um32_array_table_pt table_p, const char** cur_pp,
+                           const char* end_p);
+
+// Returns the array identified by id. The identifier is not validated.
+//
+static inline um32_array_pt
+um32_array_table_get(um32_array_table_pt table_p, uint32_t id)
+{
+    return &(table_p->arrays_p[id]);
+}
+
+// Returns true if id identifies an active array
+//
+static inline bool
+um32_array_table_isActive(um32_array_table_pt table_p, uint32_t id)
+{
+    return (id < table_p->numArrays) &&
+           (table_p->arrays_p[id].platters_p != NULL);
+}
+
+// Returns true if offset lies within the active array identified by id.
+// Inactive arrays have a length of 0, so they need no test of their own.
+//
+static inline bool
+um32_array_table_isValidOffset(um32_array_table_pt table_p, uint32_t id,
+                               uint32_t offset)
+{
+    return (id < table_p->numArrays) &&
+           (offset < table_p->arrays_p[id].length);
+}
+
+// Returns the storage that platters_p belongs to
+//
+static inline um32_array_storage_pt
+um32_array_storage_fromPlatters(um32_platter_pt platters_p)
+{
+    return (um32_array_storage_pt)(void*)((char*)platters_p -
+        offsetof(um32_array_storage_t, platters_a));
+}
+
+// Returns true if platters can be written in place: the storage is referenced
+// by a single array and has no decoded form to keep in sync
+//
+static inline bool
+um32_array_storage_isExclusive(um32_array_storage_pt storage_p)
+{
+    return (storage_p->refCount == 1) && (storage_p->decoded_p == NULL);
+}
+
+// Writes platter at offset of the array identified by id. Returns false if
+// shared storage could not be copied.
+//
+static inline bool
+um32_array_table_amend(um32_array_table_pt table_p, uint32_t id,
+                       uint32_t offset, um32_platter_t platter)
+{
+    um32_array_pt array_p = um32_array_table_get(table_p, id);
+    if (um32_array_storage_isExclusive(
+            um32_array_storage_fromPlatters(array_p->platters_p)))
+    {
+        array_p->platters_p[offset] = platter;
+        return true;
+    }
+
+    return um32_array_table_amendShared(table_p, id, offset, platter);
+}
+
+#endif /* UM32_ARRAY_H */
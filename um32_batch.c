@@ -0,0 +1,461 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#include "um32_batch.h"
+
+#include "um32_memory.h"
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// State shared by the workers. Inputs are handed out one at a time in order.
+//
+typedef struct
+{
+    um32_array_storage_pt  image_p;
+    char* const*           inputNames;
+    int                    numInputs;
+    int                    nextInput;
+    int                    numFailed;
+    pthread_mutex_t        mutex;
+} um32_batch_t;
+typedef um32_batch_t* um32_batch_pt;
+
+// Creates the output file of an input, its name with ".out" appended. Returns
+// -1 on failure.
+//
+static int
+um32_batch_openOutput(const char* inputName)
+{
+    size_t nameLength = strlen(inputName);
+    char* outputName = (char*)um32_memory_malloc(nameLength + 5);
+    if (outputName == NULL) { return -1; }
+    memcpy(outputName, inputName, nameLength);
+    memcpy(outputName + nameLength, ".out", 5);
+
+    int outputFd = open(outputName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    um32_memory_free(outputName);
+
+    return outputFd;
+}
+
+// Runs the program on a single input. Returns false, after saying why, if it
+// could not be run or the machine failed, so that a crashing input counts as
+// a failure.
+//
+static bool
+um32_batch_runInput(um32_batch_pt batch_p, const char* inputName)
+{
+    int inputFd = open(inputName, O_RDONLY);
+    int outputFd = um32_batch_openOutput(inputName);
+
+    um32_machine_pt machine_p = NULL;
+    bool result = (inputFd != -1) && (outputFd != -1) &&
+                  ((machine_p = um32_machine_create()) != NULL) &&
+                  um32_machine_initFromImage(machine_p, batch_p->image_p) &&
+                  um32_machine_setInput(machine_p, inputFd) &&
+                  um32_machine_setOutput(machine_p, outputFd);
+    if (!result)
+    {
+        printf("Unable to run input %s.\n", inputName);
+    }
+    else
+    {
+        um32_machine_setOutputBuffering(machine_p,
+                                        UM32_MACHINE_OUTPUT_FULLY_BUFFERED);
+        if (um32_machine_run(machine_p) == UM32_MACHINE_STATUS_FAULT)
+        {
+            printf("Machine failed on input %s.\n", inputName);
+            result = false;
+        }
+    }
+
+    um32_machine_free(machine_p);
+    if (outputFd != -1) { close(outputFd); }
+    if (inputFd != -1) { close(inputFd); }
+
+    return result;
+}
+
+static void*
+um32_batch_worker(void* arg_p)
+{
+    um32_batch_pt batch_p = (um32_batch_pt)arg_p;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&(batch_p->mutex));
+        int input = batch_p->nextInput++;
+        pthread_mutex_unlock(&(batch_p->mutex));
+        if (input >= batch_p->numInputs) { break; }
+
+        if (!um32_batch_runInput(batch_p, batch_p->inputNames[input]))
+        {
+            pthread_mutex_lock(&(batch_p->mutex));
+            batch_p->numFailed++;
+            pthread_mutex_unlock(&(batch_p->mutex));
+        }
+    }
+
+    return NULL;
+}
+
+int
+um32_batch_run(const char* programName, char* const* inputNames,
+               int numInputs, int numJobs)
+{
+    // Load the program image that every machine starts from
+    //
+    FILE* file_p = fopen(programName, "r");
+    if (file_p == NULL)
+    {
+        printf("Unable to open file.\n");
+        return numInputs;
+    }
+
+    um32_batch_t batch;
+    memset(&batch, 0, sizeof(batch));
+    batch.image_p = um32_machine_createImage(file_p);
+    fclose(file_p);
+    if (batch.image_p == NULL)
+    {
+        printf("Unable to load program.\n");
+        return numInputs;
+    }
+
+    batch.inputNames = inputNames;
+    batch.numInputs = numInputs;
+    pthread_mutex_init(&(batch.mutex), NULL);
+
+    // The calling thread works alongside the pool, so numJobs - 1 threads are
+    // started. Should a thread fail to start, the remaining ones carry on with
+    // its share of the inputs.
+    //
+    if (numJobs > numInputs) { numJobs = numInputs; }
+    pthread_t* threads_p = NULL;
+    int numThreads = 0;
+    if (numJobs > 1)
+    {
+        threads_p = (pthread_t*)um32_memory_malloc(
+            (size_t)(numJobs - 1) * sizeof(pthread_t));
+    }
+    while ((threads_p != NULL) && (numThreads < numJobs - 1) &&
+           (pthread_create(&(threads_p[numThreads]), NULL, um32_batch_worker,
+                           &batch) == 0))
+    {
+        numThreads++;
+    }
+
+    um32_batch_worker(&batch);
+    for (int i=0; i<numThreads; i++)
+    {
+        pthread_join(threads_p[i], NULL);
+    }
+
+    um32_memory_free(threads_p);
+    pthread_mutex_destroy(&(batch.mutex));
+    um32_array_storage_freeShared(batch.image_p);
+
+    return batch.numFailed;
+}
+
+//  Forked runs.
+//  ------------
+//
+
+// Console of the run up to the fork point. Input is handed out from memory up
+// to inputLimit, and output is collected for every child to write first.
+//
+typedef struct
+{
+    unsigned char*  input_p;
+    size_t          inputLength;
+    size_t          inputLimit;
+    size_t          inputOffset;
+    char*           output_p;
+    size_t          outputLength;
+    size_t          outputCapacity;
+} um32_batch_prefix_t;
+typedef um32_batch_prefix_t* um32_batch_prefix_pt;
+
+// Hands out input a block at a time up to the limit, and asks the machine to
+// stop once it is reached. The machine only reads again once the program has
+// consumed the previous block, so it stops at the first Input after the
+// program has read the byte before the limit, with nothing left buffered.
+//
+static ssize_t
+um32_batch_readPrefix(void* context_p, unsigned char* buf_p, size_t size)
+{
+    um32_batch_prefix_pt prefix_p = (um32_batch_prefix_pt)context_p;
+
+    size_t count = prefix_p->inputLimit - prefix_p->inputOffset;
+    if (count == 0) { return UM32_MACHINE_IO_WOULD_BLOCK; }
+
+    if (count > size) { count = size; }
+    memcpy(buf_p, prefix_p->input_p + prefix_p->inputOffset, count);
+    prefix_p->inputOffset += count;
+
+    return (ssize_t)count;
+}
+
+static ssize_t
+um32_batch_writePrefix(void* context_p, const char* buf_p, size_t size)
+{
+    um32_batch_prefix_pt prefix_p = (um32_batch_prefix_pt)context_p;
+
+    if (prefix_p->outputLength + size > prefix_p->outputCapacity)
+    {
+        size_t capacity = (prefix_p->outputCapacity == 0)
+            ? UM32_MACHINE_OUTPUT_BUFFER_SIZE
+            : prefix_p->outputCapacity;
+        while (capacity < prefix_p->outputLength + size) { capacity *= 2; }
+
+        char* output_p = (char*)um32_memory_realloc(prefix_p->output_p, capacity);
+        if (output_p == NULL) { return -1; }
+        prefix_p->output_p = output_p;
+        prefix_p->outputCapacity = capacity;
+    }
+
+    memcpy(prefix_p->output_p + prefix_p->outputLength, buf_p, size);
+    prefix_p->outputLength += size;
+
+    return (ssize_t)size;
+}
+
+// Reads the whole of a file into memory
+//
+static bool
+um32_batch_readFile(const char* name, unsigned char** data_pp, size_t* length_p)
+{
+    int fd = open(name, O_RDONLY);
+    if (fd == -1) { return false; }
+
+    struct stat fileStat;
+    unsigned char* data_p = NULL;
+    size_t length = 0;
+    bool result = (fstat(fd, &fileStat) == 0) && (fileStat.st_size >= 0);
+    if (result && (fileStat.st_size > 0))
+    {
+        data_p = (unsigned char*)um32_memory_malloc((size_t)fileStat.st_size);
+        result = (data_p != NULL);
+    }
+    while (result && (length < (size_t)fileStat.st_size))
+    {
+        ssize_t numBytes = read(fd, data_p + length,
+                                (size_t)fileStat.st_size - length);
+        if ((numBytes == -1) && (errno == EINTR)) { continue; }
+        result = (numBytes > 0);
+        if (result) { length += (size_t)numBytes; }
+    }
+    close(fd);
+
+    if (!result)
+    {
+        um32_memory_free(data_p);
+        return false;
+    }
+
+    *data_pp = data_p;
+    *length_p = length;
+
+    return true;
+}
+
+static bool
+um32_batch_writeAll(int fd, const char* buf_p, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t numBytes = write(fd, buf_p, size);
+        if ((numBytes == -1) && (errno == EINTR)) { continue; }
+        if (numBytes <= 0) { return false; }
+        buf_p += numBytes;
+        size -= (size_t)numBytes;
+    }
+
+    return true;
+}
+
+// Finishes the run in a forked child on one input. A machine that already
+// stopped before the fork point only contributes the output of the prefix.
+// Returns false, after saying why, if the input could not be run or the
+// machine failed, before or after the fork.
+//
+static bool
+um32_batch_finishInput(um32_machine_pt machine_p, um32_batch_prefix_pt prefix_p,
+                       um32_machine_status_t status, const char* inputName)
+{
+    int inputFd = open(inputName, O_RDONLY);
+    int outputFd = um32_batch_openOutput(inputName);
+
+    bool result = (inputFd != -1) && (outputFd != -1) &&
+                  um32_batch_writeAll(outputFd, prefix_p->output_p,
+                                      prefix_p->outputLength) &&
+                  um32_machine_setInput(machine_p, inputFd) &&
+                  um32_machine_setOutput(machine_p, outputFd);
+    if (!result)
+    {
+        printf("Unable to run input %s.\n", inputName);
+    }
+    else if ((status == UM32_MACHINE_STATUS_RUNNING) ||
+             (status == UM32_MACHINE_STATUS_NEEDS_INPUT))
+    {
+        um32_machine_setOutputBuffering(machine_p,
+                                        UM32_MACHINE_OUTPUT_FULLY_BUFFERED);
+        status = um32_machine_run(machine_p);
+        um32_machine_flushOutput(machine_p);
+    }
+
+    if (result && (status == UM32_MACHINE_STATUS_FAULT))
+    {
+        printf("Machine failed on input %s.\n", inputName);
+        result = false;
+    }
+
+    if (outputFd != -1) { close(outputFd); }
+    if (inputFd != -1) { close(inputFd); }
+
+    return result;
+}
+
+// Waits for a child to end. Returns false if it could not run its input.
+//
+static bool
+um32_batch_waitChild(void)
+{
+    int waitStatus;
+    while (waitpid(-1, &waitStatus, 0) == -1)
+    {
+        if (errno != EINTR) { return false; }
+    }
+
+    return WIFEXITED(waitStatus) && (WEXITSTATUS(waitStatus) == 0);
+}
+
+int
+um32_batch_runForked(const char* programName, const char* prefixName,
+                     uint64_t forkAfter, int forkMarker,
+                     char* const* inputNames, int numInputs, int numJobs)
+{
+    um32_batch_prefix_t prefix;
+    memset(&prefix, 0, sizeof(prefix));
+    if ((prefixName != NULL) &&
+        !um32_batch_readFile(prefixName, &(prefix.input_p), &(prefix.inputLength)))
+    {
+        printf("Unable to read input file.\n");
+        return numInputs;
+    }
+
+    // The prefix ends with the marker, which the program reads before the fork
+    //
+    prefix.inputLimit = prefix.inputLength;
+    if ((forkAfter == 0) && (forkMarker != -1))
+    {
+        const unsigned char* marker_p = (prefix.inputLength > 0)
+            ? (const unsigned char*)memchr(prefix.input_p, forkMarker,
+                                           prefix.inputLength)
+            : NULL;
+        if (marker_p == NULL)
+        {
+            printf("Fork marker not found in input file.\n");
+            um32_memory_free(prefix.input_p);
+            return numInputs;
+        }
+        prefix.inputLimit = (size_t)(marker_p - prefix.input_p) + 1;
+    }
+
+    FILE* file_p = fopen(programName, "r");
+    um32_machine_pt machine_p = um32_machine_create();
+    bool initialized = (file_p != NULL) && (machine_p != NULL) &&
+                       um32_machine_init(machine_p, file_p);
+    if (file_p != NULL) { fclose(file_p); }
+    if (!initialized)
+    {
+        printf("Unable to load program.\n");
+        um32_machine_free(machine_p);
+        um32_memory_free(prefix.input_p);
+        return numInputs;
+    }
+
+    // Run the shared prefix once
+    //
+    um32_machine_setCallbacks(machine_p, um32_batch_readPrefix,
+                              um32_batch_writePrefix, &prefix);
+    um32_machine_status_t status = (forkAfter > 0)
+        ? um32_machine_runFor(machine_p, forkAfter)
+        : um32_machine_run(machine_p);
+    um32_machine_flushOutput(machine_p);
+
+    // Fork a child per input, keeping at most numJobs running
+    //
+    int numRunning = 0;
+    int numFailed = 0;
+    for (int i=0; i<numInputs; i++)
+    {
+        if (numRunning == numJobs)
+        {
+            if (!um32_batch_waitChild()) { numFailed++; }
+            numRunning--;
+        }
+
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            bool result = um32_batch_finishInput(machine_p, &prefix, status,
+                                                 inputNames[i]);
+            fflush(stdout);
+            _exit(result ? 0 : 1);
+        }
+
+        if (pid == -1)
+        {
+            printf("Unable to run input %s.\n", inputNames[i]);
+            numFailed++;
+            continue;
+        }
+        numRunning++;
+    }
+
+    while (numRunning > 0)
+    {
+        if (!um32_batch_waitChild()) { numFailed++; }
+        numRunning--;
+    }
+
+    um32_machine_free(machine_p);
+    um32_memory_free(prefix.output_p);
+    um32_memory_free(prefix.input_p);
+
+    return numFailed;
+}
@@ -0,0 +1,62 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#ifndef UM32_BATCH_H
+#define UM32_BATCH_H
+
+#include "um32_machine.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Runs one machine per input file on a pool of numJobs threads. All machines
+// start from the same program image, which is read once and shared read-only;
+// a machine only copies it if the program amends its 0 array. The output of
+// each machine is written to the name of its input with ".out" appended.
+// Returns the number of inputs that could not be run or on which the machine
+// failed.
+//
+int um32_batch_run(const char* programName, char* const* inputNames,
+                   int numInputs, int numJobs);
+
+// Runs the program once up to a fork point, then forks one process per input
+// file, at most numJobs at a time, to finish the run. Each child inherits the
+// machine with all its arrays copy-on-write, so the shared prefix of the run
+// is only executed once. The prefix reads its input from prefixName, if
+// given. The fork point is after forkAfter instructions if it is not 0.
+// Otherwise it is the first Input after the program has read the first byte
+// forkMarker of prefixName, if forkMarker is not -1, and else the first Input
+// after it has read all of prefixName. Running out of input forks early in
+// every case. Output of the prefix starts every output file. Returns the
+// number of inputs that could not be run or on which the machine failed,
+// counting every input if it failed before the fork.
+//
+int um32_batch_runForked(const char* programName, const char* prefixName,
+                         uint64_t forkAfter, int forkMarker,
+                         char* const* inputNames, int numInputs, int numJobs);
+
+#endif /* UM32_BATCH_H */
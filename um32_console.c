@@ -0,0 +1,445 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#include "um32_console.h"
+
+#include "um32_memory.h"
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+//  Rings.
+//  ------
+//
+
+static bool
+um32_console_ring_init(um32_console_ring_pt ring_p, size_t size)
+{
+    ring_p->buffer_p = (unsigned char*)um32_memory_malloc(size);
+    if (ring_p->buffer_p == NULL) { return false; }
+
+    ring_p->mask = size - 1;
+    pthread_mutex_init(&(ring_p->mutex), NULL);
+    pthread_cond_init(&(ring_p->cond), NULL);
+
+    return true;
+}
+
+static void
+um32_console_ring_destroy(um32_console_ring_pt ring_p)
+{
+    if (ring_p->buffer_p == NULL) { return; }
+
+    pthread_cond_destroy(&(ring_p->cond));
+    pthread_mutex_destroy(&(ring_p->mutex));
+    um32_memory_free(ring_p->buffer_p);
+}
+
+// Returns the number of bytes waiting to be consumed
+//
+static size_t
+um32_console_ring_used(um32_console_ring_pt ring_p)
+{
+    return __atomic_load_n(&(ring_p->tail), __ATOMIC_ACQUIRE) -
+           __atomic_load_n(&(ring_p->head), __ATOMIC_ACQUIRE);
+}
+
+// Wakes the other side if it is asleep. Positions are published with
+// sequentially consistent stores, so either the sleeper sees the new position
+// before it waits or this sees the sleeper.
+//
+static void
+um32_console_ring_notify(um32_console_ring_pt ring_p)
+{
+    if (__atomic_load_n(&(ring_p->waiters), __ATOMIC_SEQ_CST) == 0) { return; }
+
+    pthread_mutex_lock(&(ring_p->mutex));
+    pthread_cond_broadcast(&(ring_p->cond));
+    pthread_mutex_unlock(&(ring_p->mutex));
+}
+
+// Sleeps until the ring holds data, or has room if forData is false. Returns
+// false instead once the ring is closed and the wait can never end. A timed
+// wait also returns true after UM32_CONSOLE_WAIT_SLICE milliseconds, ready or
+// not, so that the caller can look for other work.
+//
+static bool
+um32_console_ring_wait(um32_console_ring_pt ring_p, bool forData, bool timed)
+{
+    struct timespec deadline;
+    if (timed)
+    {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += UM32_CONSOLE_WAIT_SLICE * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+
+    pthread_mutex_lock(&(ring_p->mutex));
+    __atomic_add_fetch(&(ring_p->waiters), 1, __ATOMIC_SEQ_CST);
+
+    bool ready;
+    bool timedOut = false;
+    for (;;)
+    {
+        size_t used = um32_console_ring_used(ring_p);
+        ready = forData ? (used != 0) : (used <= ring_p->mask);
+        if (ready || ring_p->closed || timedOut) { break; }
+        if (!timed)
+        {
+            pthread_cond_wait(&(ring_p->cond), &(ring_p->mutex));
+        }
+        else if (pthread_cond_timedwait(&(ring_p->cond), &(ring_p->mutex),
+                                        &deadline) == ETIMEDOUT)
+        {
+            timedOut = true;
+        }
+    }
+
+    // Room is of no use once the consumer has gone
+    //
+    if (!forData && ring_p->closed) { ready = false; }
+    else if (timedOut && !ring_p->closed) { ready = true; }
+
+    __atomic_sub_fetch(&(ring_p->waiters), 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&(ring_p->mutex));
+
+    return ready;
+}
+
+// Marks the ring closed and wakes anybody waiting on it
+//
+static void
+um32_console_ring_close(um32_console_ring_pt ring_p)
+{
+    pthread_mutex_lock(&(ring_p->mutex));
+    ring_p->closed = true;
+    pthread_cond_broadcast(&(ring_p->cond));
+    pthread_mutex_unlock(&(ring_p->mutex));
+}
+
+// Publishes count bytes written after the tail by the producer
+//
+static void
+um32_console_ring_produce(um32_console_ring_pt ring_p, size_t count)
+{
+    __atomic_store_n(&(ring_p->tail), ring_p->tail + count, __ATOMIC_SEQ_CST);
+    um32_console_ring_notify(ring_p);
+}
+
+// Releases count bytes read from the head by the consumer
+//
+static void
+um32_console_ring_consume(um32_console_ring_pt ring_p, size_t count)
+{
+    __atomic_store_n(&(ring_p->head), ring_p->head + count, __ATOMIC_SEQ_CST);
+    um32_console_ring_notify(ring_p);
+}
+
+// Copies up to size bytes into the ring and returns how many fitted
+//
+static size_t
+um32_console_ring_put(um32_console_ring_pt ring_p, const unsigned char* buf_p,
+                      size_t size)
+{
+    size_t space = ring_p->mask + 1 - um32_console_ring_used(ring_p);
+    if (size > space) { size = space; }
+
+    size_t start = ring_p->tail & ring_p->mask;
+    size_t first = ring_p->mask + 1 - start;
+    if (first > size) { first = size; }
+    memcpy(ring_p->buffer_p + start, buf_p, first);
+    memcpy(ring_p->buffer_p, buf_p + first, size - first);
+
+    if (size > 0) { um32_console_ring_produce(ring_p, size); }
+    return size;
+}
+
+// Copies up to size bytes out of the ring and returns how many there were
+//
+static size_t
+um32_console_ring_get(um32_console_ring_pt ring_p, unsigned char* buf_p,
+                      size_t size)
+{
+    size_t used = um32_console_ring_used(ring_p);
+    if (size > used) { size = used; }
+
+    size_t start = ring_p->head & ring_p->mask;
+    size_t first = ring_p->mask + 1 - start;
+    if (first > size) { first = size; }
+    memcpy(buf_p, ring_p->buffer_p + start, first);
+    memcpy(buf_p + first, ring_p->buffer_p, size - first);
+
+    if (size > 0) { um32_console_ring_consume(ring_p, size); }
+    return size;
+}
+
+//  Threads.
+//  --------
+//
+
+// Fills the input ring straight from the input descriptor until the end of
+// input. Cancellation is only enabled around read and the poll that waits for
+// a non-blocking descriptor, so the thread is never cancelled holding the
+// ring's mutex.
+//
+static void*
+um32_console_reader(void* arg_p)
+{
+    um32_console_pt console_p = (um32_console_pt)arg_p;
+    um32_console_ring_pt ring_p = &(console_p->input);
+
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+    while (um32_console_ring_wait(ring_p, false, false))
+    {
+        size_t start = ring_p->tail & ring_p->mask;
+        size_t space = ring_p->mask + 1 - um32_console_ring_used(ring_p);
+        if (space > ring_p->mask + 1 - start) { space = ring_p->mask + 1 - start; }
+
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+        ssize_t result = read(console_p->inputFd, ring_p->buffer_p + start, space);
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+        if (result > 0)
+        {
+            um32_console_ring_produce(ring_p, (size_t)result);
+            continue;
+        }
+        if ((result == -1) && (errno == EINTR)) { continue; }
+        if ((result == -1) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+        {
+            struct pollfd pollFd = { console_p->inputFd, POLLIN, 0 };
+            pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+            poll(&pollFd, 1, -1);
+            pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+            continue;
+        }
+        if (result == -1) { printf("Error reading from input.\n"); }
+        break;
+    }
+
+    // The end of input, which Input reports once the ring has been drained
+    //
+    um32_console_ring_close(ring_p);
+
+    return NULL;
+}
+
+// Drains the output ring to the output descriptor until the console is freed
+// and everything written has gone out
+//
+static void*
+um32_console_writer(void* arg_p)
+{
+    um32_console_pt console_p = (um32_console_pt)arg_p;
+    um32_console_ring_pt ring_p = &(console_p->output);
+
+    while (um32_console_ring_wait(ring_p, true, false))
+    {
+        size_t start = ring_p->head & ring_p->mask;
+        size_t used = um32_console_ring_used(ring_p);
+        if (used > ring_p->mask + 1 - start) { used = ring_p->mask + 1 - start; }
+
+        ssize_t result = write(console_p->outputFd, ring_p->buffer_p + start, used);
+        if (result > 0)
+        {
+            um32_console_ring_consume(ring_p, (size_t)result);
+            continue;
+        }
+        if ((result == -1) && (errno == EINTR)) { continue; }
+        if ((result == -1) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+        {
+            struct pollfd pollFd = { console_p->outputFd, POLLOUT, 0 };
+            poll(&pollFd, 1, -1);
+            continue;
+        }
+
+        // Fail the writes still to come rather than let them wait for room
+        // forever
+        //
+        __atomic_store_n(&(console_p->writeFailed), true, __ATOMIC_SEQ_CST);
+        um32_console_ring_close(ring_p);
+        break;
+    }
+
+    return NULL;
+}
+
+//  Console.
+//  --------
+//
+
+// Creates a console reading from inputFd and writing to outputFd, with rings
+// of ringSize bytes, a power of two. The I/O threads run with every signal
+// blocked so that signals meant for the machine reach the thread running it.
+// The caller keeps ownership of both descriptors.
+//
+um32_console_pt
+um32_console_create(int inputFd, int outputFd, size_t ringSize)
+{
+    if ((ringSize == 0) || ((ringSize & (ringSize - 1)) != 0)) { return NULL; }
+
+    um32_console_pt console_p =
+        (um32_console_pt)um32_memory_malloc(sizeof(um32_console_t));
+    if (console_p == NULL) { return NULL; }
+
+    memset(console_p, 0, sizeof(um32_console_t));
+    console_p->inputFd = inputFd;
+    console_p->outputFd = outputFd;
+
+    // Regular files are mapped by the machine, which beats any thread
+    //
+    struct stat fileStat;
+    bool readInput = !((fstat(inputFd, &fileStat) == 0) &&
+                       S_ISREG(fileStat.st_mode));
+
+    if (!um32_console_ring_init(&(console_p->output), ringSize) ||
+        (readInput && !um32_console_ring_init(&(console_p->input), ringSize)))
+    {
+        um32_console_free(console_p);
+        return NULL;
+    }
+
+    sigset_t allSignals;
+    sigset_t oldSignals;
+    sigfillset(&allSignals);
+    pthread_sigmask(SIG_SETMASK, &allSignals, &oldSignals);
+
+    console_p->writerStarted = (pthread_create(&(console_p->writer), NULL,
+        um32_console_writer, console_p) == 0);
+    if (readInput && console_p->writerStarted)
+    {
+        console_p->readerStarted = (pthread_create(&(console_p->reader), NULL,
+            um32_console_reader, console_p) == 0);
+    }
+
+    pthread_sigmask(SIG_SETMASK, &oldSignals, NULL);
+
+    if (!console_p->writerStarted || (readInput && !console_p->readerStarted))
+    {
+        um32_console_free(console_p);
+        return NULL;
+    }
+
+    return console_p;
+}
+
+// Writes out everything still in the output ring and stops the I/O threads.
+// Machines attached to the console must have been freed or given another
+// console first.
+//
+void
+um32_console_free(um32_console_pt console_p)
+{
+    if (console_p == NULL) { return; }
+
+    if (console_p->readerStarted)
+    {
+        um32_console_ring_close(&(console_p->input));
+        pthread_cancel(console_p->reader);
+        pthread_join(console_p->reader, NULL);
+    }
+
+    if (console_p->writerStarted)
+    {
+        um32_console_ring_close(&(console_p->output));
+        pthread_join(console_p->writer, NULL);
+    }
+
+    um32_console_ring_destroy(&(console_p->input));
+    um32_console_ring_destroy(&(console_p->output));
+    um32_memory_free(console_p);
+}
+
+// Makes the machine's Input and Output use the console. Input from a regular
+// file is still mapped by the machine.
+//
+void
+um32_console_attach(um32_console_pt console_p, um32_machine_pt machine_p)
+{
+    um32_machine_setCallbacks(machine_p,
+        console_p->readerStarted ? um32_console_read : NULL,
+        um32_console_write, console_p);
+    if (!console_p->readerStarted)
+    {
+        um32_machine_setInput(machine_p, console_p->inputFd);
+    }
+}
+
+// Read callback for the machine: takes whatever the input ring holds, waiting
+// only if it is empty. Returns 0 at the end of input, or
+// UM32_MACHINE_IO_WOULD_BLOCK if a snapshot or sample is requested while it
+// waits, so that the machine takes it before Input runs again.
+//
+ssize_t
+um32_console_read(void* context_p, unsigned char* buf_p, size_t size)
+{
+    um32_console_ring_pt ring_p = &(((um32_console_pt)context_p)->input);
+
+    size_t count = um32_console_ring_get(ring_p, buf_p, size);
+    while (count == 0)
+    {
+        if (um32_machine_hasRequests()) { return UM32_MACHINE_IO_WOULD_BLOCK; }
+        if (!um32_console_ring_wait(ring_p, true, true)) { return 0; }
+        count = um32_console_ring_get(ring_p, buf_p, size);
+    }
+
+    return (ssize_t)count;
+}
+
+// Write callback for the machine: copies as much as fits into the output ring,
+// waiting only if it is full. Returns -1 once writing to the output descriptor
+// has failed, or UM32_MACHINE_IO_WOULD_BLOCK if a snapshot or sample is
+// requested while it waits.
+//
+ssize_t
+um32_console_write(void* context_p, const char* buf_p, size_t size)
+{
+    um32_console_pt console_p = (um32_console_pt)context_p;
+    um32_console_ring_pt ring_p = &(console_p->output);
+
+    size_t count = 0;
+    while (!__atomic_load_n(&(console_p->writeFailed), __ATOMIC_SEQ_CST))
+    {
+        count = um32_console_ring_put(ring_p, (const unsigned char*)buf_p, size);
+        if (count > 0) { break; }
+        if (um32_machine_hasRequests()) { return UM32_MACHINE_IO_WOULD_BLOCK; }
+        if (!um32_console_ring_wait(ring_p, false, true)) { break; }
+    }
+
+    return (count > 0) ? (ssize_t)count : -1;
+}
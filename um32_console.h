@@ -0,0 +1,97 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#ifndef UM32_CONSOLE_H
+#define UM32_CONSOLE_H
+
+#include "um32_machine.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+// Default capacity of each ring, in bytes. Must be a power of two.
+//
+#define UM32_CONSOLE_DEFAULT_RING_SIZE (1024 * 1024)
+
+// Longest time, in milliseconds, that Input and Output wait on a ring before
+// checking for snapshot and sample requests, which signals cannot wake them for
+//
+#define UM32_CONSOLE_WAIT_SLICE 50
+
+#define UM32_CONSOLE_CACHE_LINE 64
+
+// Single-producer, single-consumer byte ring. The producer only ever advances
+// tail and the consumer head, each on a cache line of its own, so neither
+// takes a lock to move data. A side that finds the ring empty or full sleeps
+// on the condition variable, and the other side only takes the mutex to wake
+// it when waiters says somebody is asleep.
+//
+typedef struct
+{
+    size_t           head;
+    char             headPad_a[UM32_CONSOLE_CACHE_LINE - sizeof(size_t)];
+    size_t           tail;
+    char             tailPad_a[UM32_CONSOLE_CACHE_LINE - sizeof(size_t)];
+    unsigned char*   buffer_p;
+    size_t           mask;
+    int              waiters;
+    bool             closed;
+    pthread_mutex_t  mutex;
+    pthread_cond_t   cond;
+} um32_console_ring_t;
+typedef um32_console_ring_t* um32_console_ring_pt;
+
+// Console serviced by I/O threads. The machine's Output only copies into the
+// output ring, and a writer thread drains it to outputFd; a reader thread
+// keeps the input ring filled from inputFd, so Input only waits when nothing
+// has arrived yet. Output waits for room when the writer falls a whole ring
+// behind. Regular input files are left to the machine, which maps them.
+//
+typedef struct
+{
+    int                  inputFd;
+    int                  outputFd;
+    um32_console_ring_t  input;
+    um32_console_ring_t  output;
+    pthread_t            reader;
+    pthread_t            writer;
+    bool                 readerStarted;
+    bool                 writerStarted;
+    bool                 writeFailed;
+} um32_console_t;
+typedef um32_console_t* um32_console_pt;
+
+um32_console_pt um32_console_create(int inputFd, int outputFd,
+                                    size_t ringSize);
+void um32_console_free(um32_console_pt console_p);
+void um32_console_attach(um32_console_pt console_p, um32_machine_pt machine_p);
+ssize_t um32_console_read(void* context_p, unsigned char* buf_p, size_t size);
+ssize_t um32_console_write(void* context_p, const char* buf_p, size_t size);
+
+#endif /* UM32_CONSOLE_H */
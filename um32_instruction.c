@@ -0,0 +1,155 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#include "um32_instruction.h"
+
+um32_instruction_t
+um32_instruction_decode(um32_platter_t platter)
+{
+    um32_instruction_t instruction;
+
+    instruction.operatorNum = platter.operatorNum;
+#ifdef UM32_INSTRUCTION_SPECIALIZED_HANDLERS
+    instruction.handler = platter.operatorNum;
+#endif
+    if (platter.operatorNum == UM32_OPERATOR_ORTHOGRAPHY)
+    {
+        um32_platter_special_t special =
+            um32_platter_special_fromPlatter(platter);
+        instruction.regA = special.regA;
+        instruction.regB = 0;
+        instruction.regC = 0;
+        instruction.value = special.value;
+    }
+    else
+    {
+        instruction.regA = platter.regA;
+        instruction.regB = platter.regB;
+        instruction.regC = platter.regC;
+        instruction.value = 0;
+    }
+
+    return instruction;
+}
+
+// Decodes length platters into instructions_p, which must have room for one
+// more instruction than that for the end sentinel, and marks superinstructions
+//
+void
+um32_instruction_decodeArray(um32_instruction_pt instructions_p,
+                             const um32_platter_t* platters_p,
+                             uint32_t length)
+{
+    for (uint32_t i=0; i<length; i++)
+    {
+        instructions_p[i] = um32_instruction_decode(platters_p[i]);
+        if (i > 0) { um32_instruction_fuse(instructions_p, i - 1); }
+    }
+
+    instructions_p[length].operatorNum = UM32_INSTRUCTION_OPERATOR_END;
+#ifdef UM32_INSTRUCTION_SPECIALIZED_HANDLERS
+    instructions_p[length].handler = UM32_INSTRUCTION_OPERATOR_END;
+#endif
+    instructions_p[length].regA = 0;
+    instructions_p[length].regB = 0;
+    instructions_p[length].regC = 0;
+    instructions_p[length].value = 0;
+    if (length > 0) { um32_instruction_fuse(instructions_p, length - 1); }
+}
+
+#ifdef UM32_INSTRUCTION_SPECIALIZED_HANDLERS
+// Returns the handler for an instruction whose operator has been settled.
+// Superinstructions and operators that may call out of the engine keep their
+// generic handler.
+//
+static uint16_t
+um32_instruction_selectHandler(um32_instruction_t instruction)
+{
+    uint16_t registers =
+        (uint16_t)((instruction.regA << 6) | (instruction.regB << 3) |
+                   instruction.regC);
+
+    switch (instruction.operatorNum)
+    {
+    case UM32_OPERATOR_CONDITIONAL_MOVE:
+        return UM32_INSTRUCTION_HANDLER_CONDITIONAL_MOVE + registers;
+    case UM32_OPERATOR_ADDITION:
+        return UM32_INSTRUCTION_HANDLER_ADDITION + registers;
+    case UM32_OPERATOR_MULTIPLICATION:
+        return UM32_INSTRUCTION_HANDLER_MULTIPLICATION + registers;
+    case UM32_OPERATOR_DIVISION:
+        return UM32_INSTRUCTION_HANDLER_DIVISION + registers;
+    case UM32_OPERATOR_NOT_AND:
+        return UM32_INSTRUCTION_HANDLER_NOT_AND + registers;
+    case UM32_OPERATOR_ORTHOGRAPHY:
+        return UM32_INSTRUCTION_HANDLER_ORTHOGRAPHY + instruction.regA;
+    default:
+        break;
+    }
+
+    return instruction.operatorNum;
+}
+#endif
+
+// Marks the instruction at offset as a superinstruction if it starts a pair
+// with the next one, or unmarks it if it no longer does, and selects its
+// handler. The next instruction may be the end sentinel, which never pairs.
+// Called again for the instruction before an amended one.
+//
+void
+um32_instruction_fuse(um32_instruction_pt instructions_p, uint32_t offset)
+{
+    uint8_t first = um32_instruction_baseOperator(
+        instructions_p[offset].operatorNum);
+    uint8_t second = um32_instruction_baseOperator(
+        instructions_p[offset + 1].operatorNum);
+
+    uint8_t operatorNum = first;
+    if (first == UM32_OPERATOR_ORTHOGRAPHY)
+    {
+        if (second == UM32_OPERATOR_ORTHOGRAPHY)
+        {
+            operatorNum = UM32_INSTRUCTION_OPERATOR_ORTHOGRAPHY_PAIR;
+        }
+        else if (second == UM32_OPERATOR_LOAD_PROGRAM)
+        {
+            operatorNum = UM32_INSTRUCTION_OPERATOR_ORTHOGRAPHY_LOAD_PROGRAM;
+        }
+    }
+    else if ((first == UM32_OPERATOR_NOT_AND) &&
+             (second == UM32_OPERATOR_NOT_AND))
+    {
+        operatorNum = UM32_INSTRUCTION_OPERATOR_NOT_AND_PAIR;
+    }
+
+    instructions_p[offset].operatorNum = operatorNum;
+#ifdef UM32_INSTRUCTION_SPECIALIZED_HANDLERS
+    instructions_p[offset].handler =
+        um32_instruction_selectHandler(instructions_p[offset]);
+#endif
+}
@@ -0,0 +1,122 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#ifndef UM32_INSTRUCTION_H
+#define UM32_INSTRUCTION_H
+
+#include "um32_platter.h"
+#include <stdint.h>
+
+// Operator number of the sentinel placed after the last instruction of a
+// decoded program. Executing it stops the machine the same way running off the
+// end of the '0' array does.
+//
+#define UM32_INSTRUCTION_OPERATOR_END 16
+
+// Operator numbers of superinstructions. Decoding marks the first of a common
+// pair of instructions with one of these so the threaded engine discharges
+// both with a single dispatch. The second instruction keeps its own entry, so
+// jumping to it still works, and every other engine discharges a marked
+// instruction as its base operator alone.
+//
+//  Orthography Pair              two Orthographies building constants
+//  Not-And Pair                  two Not-Ands, as in NOT, AND, OR and XOR
+//  Orthography Load Program      an Orthography setting up a jump
+//
+#define UM32_INSTRUCTION_OPERATOR_ORTHOGRAPHY_PAIR          17
+#define UM32_INSTRUCTION_OPERATOR_NOT_AND_PAIR              18
+#define UM32_INSTRUCTION_OPERATOR_ORTHOGRAPHY_LOAD_PROGRAM  19
+#define UM32_INSTRUCTION_NUM_OPERATORS                      20
+
+// Handler numbers. Builds with UM32_INSTRUCTION_SPECIALIZED_HANDLERS defined
+// give the threaded engine handlers specialized for one combination of
+// registers, and it dispatches on the handler chosen for an instruction when
+// it is decoded rather than on its operator. The first
+// UM32_INSTRUCTION_NUM_OPERATORS handlers are the generic handler of each
+// operator, which look up their registers in the instruction. The others come
+// in 512 for each operator below, indexed by regA * 64 + regB * 8 + regC, and
+// 8 for Orthography, indexed by regA, so that they work on fixed registers.
+//
+#define UM32_INSTRUCTION_HANDLER_CONDITIONAL_MOVE  (UM32_INSTRUCTION_NUM_OPERATORS)
+#define UM32_INSTRUCTION_HANDLER_ADDITION          (UM32_INSTRUCTION_NUM_OPERATORS + 512)
+#define UM32_INSTRUCTION_HANDLER_MULTIPLICATION    (UM32_INSTRUCTION_NUM_OPERATORS + 1024)
+#define UM32_INSTRUCTION_HANDLER_DIVISION          (UM32_INSTRUCTION_NUM_OPERATORS + 1536)
+#define UM32_INSTRUCTION_HANDLER_NOT_AND           (UM32_INSTRUCTION_NUM_OPERATORS + 2048)
+#define UM32_INSTRUCTION_HANDLER_ORTHOGRAPHY       (UM32_INSTRUCTION_NUM_OPERATORS + 2560)
+#ifdef UM32_INSTRUCTION_SPECIALIZED_HANDLERS
+#define UM32_INSTRUCTION_NUM_HANDLERS              (UM32_INSTRUCTION_NUM_OPERATORS + 2568)
+#else
+#define UM32_INSTRUCTION_NUM_HANDLERS              (UM32_INSTRUCTION_NUM_OPERATORS)
+#endif
+
+// Structure representing a predecoded instruction platter. The operator number
+// and the register indices are extracted once when the program is loaded so
+// that the Spin Cycle does not need to pick apart bitfields. For Orthography
+// the register A and the value are taken from the special interpretation of
+// the platter. The handler is only kept by builds with specialized handlers,
+// after the fields every engine reads, so that the others keep 8 byte
+// instructions.
+//
+typedef struct
+{
+    uint8_t   operatorNum;
+    uint8_t   regA;
+    uint8_t   regB;
+    uint8_t   regC;
+    uint32_t  value;
+#ifdef UM32_INSTRUCTION_SPECIALIZED_HANDLERS
+    uint16_t  handler;
+#endif
+} um32_instruction_t;
+typedef um32_instruction_t* um32_instruction_pt;
+
+um32_instruction_t um32_instruction_decode(um32_platter_t platter);
+void um32_instruction_decodeArray(um32_instruction_pt instructions_p,
+                                  const um32_platter_t* platters_p,
+                                  uint32_t length);
+void um32_instruction_fuse(um32_instruction_pt instructions_p, uint32_t offset);
+
+// Returns the operator an instruction discharges on its own, looking through
+// superinstructions
+//
+static inline uint8_t
+um32_instruction_baseOperator(uint8_t operatorNum)
+{
+    switch (operatorNum)
+    {
+    case UM32_INSTRUCTION_OPERATOR_ORTHOGRAPHY_PAIR:
+    case UM32_INSTRUCTION_OPERATOR_ORTHOGRAPHY_LOAD_PROGRAM:
+        return UM32_OPERATOR_ORTHOGRAPHY;
+    case UM32_INSTRUCTION_OPERATOR_NOT_AND_PAIR:
+        return UM32_OPERATOR_NOT_AND;
+    default:
+        return operatorNum;
+    }
+}
+
+#endif /* UM32_INSTRUCTION_H */
@@ -0,0 +1,481 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#include "um32_jit.h"
+
+#ifdef UM32_JIT_SUPPORTED
+
+#include "um32_machine.h"
+#include "um32_memory.h"
+#include <string.h>
+#include <sys/mman.h>
+
+// Size of the executable code buffer. When it fills up every block is thrown
+// away and compilation starts again from the beginning of the buffer.
+//
+#define UM32_JIT_CODE_SIZE (32 * 1024 * 1024)
+
+// Upper bound on the machine code emitted for one instruction, used to make
+// sure a whole block fits before it is compiled
+//
+#define UM32_JIT_MAX_INSTRUCTION_BYTES 64
+#define UM32_JIT_MAX_BLOCK_BYTES \
+    (256 + (UM32_JIT_MAX_BLOCK_LENGTH * UM32_JIT_MAX_INSTRUCTION_BYTES))
+
+// The array lookup below indexes the table with a shift, and Array Amendment
+// inspects the storage header at fixed offsets below the platters
+//
+typedef char um32_jit_arrayLayoutCheck_t
+    [((sizeof(um32_array_t) == 16) && (offsetof(um32_array_t, platters_p) == 0))
+     ? 1 : -1];
+typedef char um32_jit_storageLayoutCheck_t
+    [((offsetof(um32_array_storage_t, decoded_p) == 0) &&
+      (offsetof(um32_array_storage_t, refCount) == 8) &&
+      (offsetof(um32_array_storage_t, platters_a) == 16)) ? 1 : -1];
+
+// Host registers. Guest register n lives in host register R8 + n for the
+// duration of a block; RDI holds the guest register file and RSI the array
+// table. RAX, RCX and RDX are scratch.
+//
+enum
+{
+    UM32_JIT_RAX = 0,
+    UM32_JIT_RCX = 1,
+    UM32_JIT_RDX = 2,
+    UM32_JIT_RSI = 6,
+    UM32_JIT_RDI = 7,
+    UM32_JIT_R8  = 8,
+    UM32_JIT_R12 = 12,
+    UM32_JIT_R15 = 15,
+};
+
+#define UM32_JIT_GUEST(reg) (UM32_JIT_R8 + (reg))
+
+//  Instruction encoding helpers.
+//  -----------------------------
+//
+
+static inline void
+um32_jit_emit8(uint8_t** code_pp, uint8_t byte)
+{
+    *((*code_pp)++) = byte;
+}
+
+static inline void
+um32_jit_emit32(uint8_t** code_pp, uint32_t val)
+{
+    memcpy(*code_pp, &val, sizeof(val));
+    *code_pp += sizeof(val);
+}
+
+// Emits a REX prefix if one is needed for a 64-bit operand size or for any of
+// the extended registers
+//
+static inline void
+um32_jit_emitRex(uint8_t** code_pp, int w, int reg, int index, int rm)
+{
+    uint8_t rex = 0x40 | (w << 3) | (((reg >> 3) & 1) << 2) |
+                  (((index >> 3) & 1) << 1) | ((rm >> 3) & 1);
+    if (rex != 0x40) { um32_jit_emit8(code_pp, rex); }
+}
+
+// Emits opcode followed by a register-direct ModRM byte
+//
+static inline void
+um32_jit_emitRR(uint8_t** code_pp, int w, uint8_t opcode, int reg, int rm)
+{
+    um32_jit_emitRex(code_pp, w, reg, 0, rm);
+    um32_jit_emit8(code_pp, opcode);
+    um32_jit_emit8(code_pp, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+// Emits a two byte opcode followed by a register-direct ModRM byte
+//
+static inline void
+um32_jit_emitRR0F(uint8_t** code_pp, uint8_t opcode, int reg, int rm)
+{
+    um32_jit_emitRex(code_pp, 0, reg, 0, rm);
+    um32_jit_emit8(code_pp, 0x0F);
+    um32_jit_emit8(code_pp, opcode);
+    um32_jit_emit8(code_pp, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+// Emits opcode with a [base + index * 2^scale] memory operand
+//
+static inline void
+um32_jit_emitSib(uint8_t** code_pp, int w, uint8_t opcode, int reg,
+                 int base, int index, int scale)
+{
+    um32_jit_emitRex(code_pp, w, reg, index, base);
+    um32_jit_emit8(code_pp, opcode);
+    um32_jit_emit8(code_pp, ((reg & 7) << 3) | 4);
+    um32_jit_emit8(code_pp, (scale << 6) | ((index & 7) << 3) | (base & 7));
+}
+
+// Emits opcode with a [RDI + disp8] memory operand
+//
+static inline void
+um32_jit_emitRegFile(uint8_t** code_pp, uint8_t opcode, int reg, int n)
+{
+    um32_jit_emitRex(code_pp, 0, reg, 0, UM32_JIT_RDI);
+    um32_jit_emit8(code_pp, opcode);
+    um32_jit_emit8(code_pp, 0x40 | ((reg & 7) << 3) | UM32_JIT_RDI);
+    um32_jit_emit8(code_pp, (uint8_t)(n * sizeof(uint32_t)));
+}
+
+static inline void
+um32_jit_emitMov(uint8_t** code_pp, int dst, int src)
+{
+    um32_jit_emitRR(code_pp, 0, 0x89, src, dst);
+}
+
+static inline void
+um32_jit_emitMovImm(uint8_t** code_pp, int dst, uint32_t imm)
+{
+    um32_jit_emitRex(code_pp, 0, 0, 0, dst);
+    um32_jit_emit8(code_pp, 0xB8 + (dst & 7));
+    um32_jit_emit32(code_pp, imm);
+}
+
+static inline void
+um32_jit_emitJmp(uint8_t** code_pp, const uint8_t* target_p)
+{
+    um32_jit_emit8(code_pp, 0xE9);
+    um32_jit_emit32(code_pp, (uint32_t)(target_p - (*code_pp + 4)));
+}
+
+// Loads the platters pointer of the array identified by guest register reg
+// into RAX
+//
+static inline void
+um32_jit_emitArrayBase(uint8_t** code_pp, int reg)
+{
+    um32_jit_emitMov(code_pp, UM32_JIT_RCX, UM32_JIT_GUEST(reg));
+    um32_jit_emitRR(code_pp, 1, 0xC1, 4, UM32_JIT_RCX);   // shl rcx, 4
+    um32_jit_emit8(code_pp, 4);
+    um32_jit_emitSib(code_pp, 1, 0x8B, UM32_JIT_RAX,
+                     UM32_JIT_RSI, UM32_JIT_RCX, 0);      // mov rax, [rsi+rcx]
+}
+
+// Length of the sequence emitted by um32_jit_emitExit when interpret is set
+//
+#define UM32_JIT_EXIT_INTERPRET_BYTES 15
+
+// Leaves the block through the epilogue, returning offset and optionally
+// asking for the instruction there to be interpreted
+//
+static inline void
+um32_jit_emitExit(uint8_t** code_pp, const uint8_t* epilogue_p,
+                  uint32_t offset, bool interpret)
+{
+    um32_jit_emitMovImm(code_pp, UM32_JIT_RAX, offset);
+    if (interpret)
+    {
+        // bts rax, 32
+        um32_jit_emit8(code_pp, 0x48);
+        um32_jit_emit8(code_pp, 0x0F);
+        um32_jit_emit8(code_pp, 0xBA);
+        um32_jit_emit8(code_pp, 0xE8);
+        um32_jit_emit8(code_pp, 32);
+    }
+    um32_jit_emitJmp(code_pp, epilogue_p);
+}
+
+//  Translation.
+//  ------------
+//
+
+static bool
+um32_jit_isSupported(um32_instruction_t instruction)
+{
+    switch (um32_instruction_baseOperator(instruction.operatorNum))
+    {
+    case UM32_OPERATOR_CONDITIONAL_MOVE:
+    case UM32_OPERATOR_ARRAY_INDEX:
+    case UM32_OPERATOR_ARRAY_AMENDMENT:
+    case UM32_OPERATOR_ADDITION:
+    case UM32_OPERATOR_MULTIPLICATION:
+    case UM32_OPERATOR_DIVISION:
+    case UM32_OPERATOR_NOT_AND:
+    case UM32_OPERATOR_LOAD_PROGRAM:
+    case UM32_OPERATOR_ORTHOGRAPHY:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Translates the basic block starting at offset. The block ends after a Load
+// Program, before any instruction the JIT does not handle (Halt, Allocation,
+// Abandonment, Output, Input) or after UM32_JIT_MAX_BLOCK_LENGTH instructions.
+// Returns the number of instructions translated.
+//
+static uint32_t
+um32_jit_compileBlock(uint8_t** code_pp, const uint8_t* epilogue_p,
+                      const um32_instruction_t* decoded_p, uint32_t offset)
+{
+    uint32_t length = 0;
+
+    while (length < UM32_JIT_MAX_BLOCK_LENGTH)
+    {
+        uint32_t curOffset = offset + length;
+        um32_instruction_t instruction = decoded_p[curOffset];
+        int regA = UM32_JIT_GUEST(instruction.regA);
+        int regB = UM32_JIT_GUEST(instruction.regB);
+        int regC = UM32_JIT_GUEST(instruction.regC);
+
+        switch (um32_instruction_baseOperator(instruction.operatorNum))
+        {
+        case UM32_OPERATOR_CONDITIONAL_MOVE:
+            um32_jit_emitRR(code_pp, 0, 0x85, regC, regC);    // test C, C
+            um32_jit_emitRR0F(code_pp, 0x45, regA, regB);     // cmovne A, B
+            break;
+        case UM32_OPERATOR_ARRAY_INDEX:
+            um32_jit_emitArrayBase(code_pp, instruction.regB);
+            um32_jit_emitMov(code_pp, UM32_JIT_RCX, regC);
+            um32_jit_emitSib(code_pp, 0, 0x8B, UM32_JIT_RAX,
+                             UM32_JIT_RAX, UM32_JIT_RCX, 2);
+            um32_jit_emitMov(code_pp, regA, UM32_JIT_RAX);
+            break;
+        case UM32_OPERATOR_ARRAY_AMENDMENT:
+            // Amending shared storage or storage loaded as a program, which
+            // includes the 0 array, leaves the block so the interpreter can
+            // copy the storage and keep decoded programs and compiled blocks
+            // in sync
+            //
+            um32_jit_emitArrayBase(code_pp, instruction.regA);
+            um32_jit_emit8(code_pp, 0x48);                    // cmp qword
+            um32_jit_emit8(code_pp, 0x83);                    //   [rax-16], 0
+            um32_jit_emit8(code_pp, 0x78);
+            um32_jit_emit8(code_pp, 0xF0);
+            um32_jit_emit8(code_pp, 0x00);
+            um32_jit_emit8(code_pp, 0x75);                    // jne exit
+            um32_jit_emit8(code_pp, 6);
+            um32_jit_emit8(code_pp, 0x83);                    // cmp dword
+            um32_jit_emit8(code_pp, 0x78);                    //   [rax-8], 1
+            um32_jit_emit8(code_pp, 0xF8);
+            um32_jit_emit8(code_pp, 0x01);
+            um32_jit_emit8(code_pp, 0x74);                    // je store
+            um32_jit_emit8(code_pp, UM32_JIT_EXIT_INTERPRET_BYTES);
+            um32_jit_emitExit(code_pp, epilogue_p, curOffset, true);
+            um32_jit_emitMov(code_pp, UM32_JIT_RCX, regB);
+            um32_jit_emitMov(code_pp, UM32_JIT_RDX, regC);
+            um32_jit_emitSib(code_pp, 0, 0x89, UM32_JIT_RDX,
+                             UM32_JIT_RAX, UM32_JIT_RCX, 2);
+            break;
+        case UM32_OPERATOR_ADDITION:
+            um32_jit_emitMov(code_pp, UM32_JIT_RAX, regB);
+            um32_jit_emitRR(code_pp, 0, 0x01, regC, UM32_JIT_RAX);
+            um32_jit_emitMov(code_pp, regA, UM32_JIT_RAX);
+            break;
+        case UM32_OPERATOR_MULTIPLICATION:
+            um32_jit_emitMov(code_pp, UM32_JIT_RAX, regB);
+            um32_jit_emitRR0F(code_pp, 0xAF, UM32_JIT_RAX, regC);
+            um32_jit_emitMov(code_pp, regA, UM32_JIT_RAX);
+            break;
+        case UM32_OPERATOR_DIVISION:
+            // Division by zero is left to the interpreter, which fails the
+            // machine
+            //
+            um32_jit_emitRR(code_pp, 0, 0x85, regC, regC);    // test C, C
+            um32_jit_emit8(code_pp, 0x75);                    // jnz
+            um32_jit_emit8(code_pp, UM32_JIT_EXIT_INTERPRET_BYTES);
+            um32_jit_emitExit(code_pp, epilogue_p, curOffset, true);
+            um32_jit_emitMov(code_pp, UM32_JIT_RAX, regB);
+            um32_jit_emitRR(code_pp, 0, 0x31, UM32_JIT_RDX, UM32_JIT_RDX);
+            um32_jit_emitRR(code_pp, 0, 0xF7, 6, regC);       // div C
+            um32_jit_emitMov(code_pp, regA, UM32_JIT_RAX);
+            break;
+        case UM32_OPERATOR_NOT_AND:
+            um32_jit_emitMov(code_pp, UM32_JIT_RAX, regB);
+            um32_jit_emitRR(code_pp, 0, 0x21, regC, UM32_JIT_RAX);
+            um32_jit_emitRR(code_pp, 0, 0xF7, 2, UM32_JIT_RAX);   // not eax
+            um32_jit_emitMov(code_pp, regA, UM32_JIT_RAX);
+            break;
+        case UM32_OPERATOR_ORTHOGRAPHY:
+            um32_jit_emitMovImm(code_pp, regA, instruction.value);
+            break;
+        case UM32_OPERATOR_LOAD_PROGRAM:
+            // Only a jump within the 0 array stays in compiled code
+            //
+            um32_jit_emitRR(code_pp, 0, 0x85, regB, regB);    // test B, B
+            um32_jit_emit8(code_pp, 0x74);                    // jz
+            um32_jit_emit8(code_pp, UM32_JIT_EXIT_INTERPRET_BYTES);
+            um32_jit_emitExit(code_pp, epilogue_p, curOffset, true);
+            um32_jit_emitMov(code_pp, UM32_JIT_RAX, regC);
+            um32_jit_emitJmp(code_pp, epilogue_p);
+            return length + 1;
+        default:
+            um32_jit_emitExit(code_pp, epilogue_p, curOffset, true);
+            return length;
+        }
+
+        length++;
+    }
+
+    um32_jit_emitExit(code_pp, epilogue_p, offset + length, false);
+    return length;
+}
+
+um32_jit_pt
+um32_jit_create(uint32_t length)
+{
+    um32_jit_pt jit_p = (um32_jit_pt)um32_memory_malloc(sizeof(um32_jit_t));
+    if (jit_p == NULL) { return NULL; }
+    memset(jit_p, 0, sizeof(um32_jit_t));
+
+    void* code_p = mmap(NULL, UM32_JIT_CODE_SIZE,
+                        PROT_READ | PROT_WRITE | PROT_EXEC,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code_p == MAP_FAILED)
+    {
+        um32_memory_free(jit_p);
+        return NULL;
+    }
+    jit_p->code_p = (uint8_t*)code_p;
+    jit_p->codeSize = UM32_JIT_CODE_SIZE;
+
+    if (!um32_jit_reset(jit_p, length))
+    {
+        um32_jit_free(jit_p);
+        return NULL;
+    }
+
+    return jit_p;
+}
+
+void
+um32_jit_free(um32_jit_pt jit_p)
+{
+    if (jit_p == NULL) { return; }
+
+    if (jit_p->code_p != NULL) { munmap(jit_p->code_p, jit_p->codeSize); }
+    um32_memory_free(jit_p->entries_p);
+    um32_memory_free(jit_p);
+}
+
+// Throws away every compiled block and prepares for a '0' array of length
+// instructions
+//
+bool
+um32_jit_reset(um32_jit_pt jit_p, uint32_t length)
+{
+    um32_jit_entry_pt entries_p = (um32_jit_entry_pt)um32_memory_realloc(
+        jit_p->entries_p, ((size_t)length + 1) * sizeof(um32_jit_entry_t));
+    if (entries_p == NULL) { return false; }
+
+    memset(entries_p, 0, ((size_t)length + 1) * sizeof(um32_jit_entry_t));
+    jit_p->entries_p = entries_p;
+    jit_p->length = length;
+    jit_p->codeUsed = 0;
+
+    return true;
+}
+
+// Returns the compiled block starting at offset, translating it first if
+// needed. Returns NULL if the instruction at offset must be interpreted.
+//
+um32_jit_block_t
+um32_jit_getBlock(um32_jit_pt jit_p, const um32_instruction_t* decoded_p,
+                  uint32_t offset)
+{
+    um32_jit_entry_pt entry_p = &(jit_p->entries_p[offset]);
+    if (entry_p->block_p != NULL) { return entry_p->block_p; }
+
+    if (!um32_jit_isSupported(decoded_p[offset])) { return NULL; }
+
+    // Start over with an empty buffer if this block might not fit
+    //
+    if (jit_p->codeSize - jit_p->codeUsed < UM32_JIT_MAX_BLOCK_BYTES)
+    {
+        memset(jit_p->entries_p, 0,
+               ((size_t)jit_p->length + 1) * sizeof(um32_jit_entry_t));
+        jit_p->codeUsed = 0;
+    }
+
+    uint8_t* code_p = jit_p->code_p + jit_p->codeUsed;
+
+    // The epilogue comes first so that every exit is a backward jump to a
+    // known address. It writes the guest registers back and restores the
+    // callee-saved registers.
+    //
+    uint8_t* epilogue_p = code_p;
+    for (int n=0; n<UM32_NUM_GENERAL_PURPOSE_REGISTERS; n++)
+    {
+        um32_jit_emitRegFile(&code_p, 0x89, UM32_JIT_GUEST(n), n);
+    }
+    for (int reg=UM32_JIT_R15; reg>=UM32_JIT_R12; reg--)
+    {
+        um32_jit_emit8(&code_p, 0x41);
+        um32_jit_emit8(&code_p, 0x58 + (reg & 7));            // pop reg
+    }
+    um32_jit_emit8(&code_p, 0xC3);                            // ret
+
+    // Prologue saves the callee-saved registers and loads the guest registers
+    //
+    uint8_t* block_p = code_p;
+    for (int reg=UM32_JIT_R12; reg<=UM32_JIT_R15; reg++)
+    {
+        um32_jit_emit8(&code_p, 0x41);
+        um32_jit_emit8(&code_p, 0x50 + (reg & 7));            // push reg
+    }
+    for (int n=0; n<UM32_NUM_GENERAL_PURPOSE_REGISTERS; n++)
+    {
+        um32_jit_emitRegFile(&code_p, 0x8B, UM32_JIT_GUEST(n), n);
+    }
+
+    entry_p->length = um32_jit_compileBlock(&code_p, epilogue_p,
+                                            decoded_p, offset);
+    entry_p->block_p = (um32_jit_block_t)(void*)block_p;
+    jit_p->codeUsed = (size_t)(code_p - jit_p->code_p);
+
+    return entry_p->block_p;
+}
+
+// Drops every compiled block that covers the instruction at offset
+//
+void
+um32_jit_invalidate(um32_jit_pt jit_p, uint32_t offset)
+{
+    if (offset >= jit_p->length) { return; }
+
+    uint32_t first = (offset >= UM32_JIT_MAX_BLOCK_LENGTH)
+                   ? (offset - UM32_JIT_MAX_BLOCK_LENGTH + 1)
+                   : 0;
+    for (uint32_t start=first; start<=offset; start++)
+    {
+        um32_jit_entry_pt entry_p = &(jit_p->entries_p[start]);
+        if ((entry_p->block_p != NULL) && (start + entry_p->length > offset))
+        {
+            entry_p->block_p = NULL;
+            entry_p->length = 0;
+        }
+    }
+}
+
+#endif /* UM32_JIT_SUPPORTED */
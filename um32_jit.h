@@ -0,0 +1,87 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#ifndef UM32_JIT_H
+#define UM32_JIT_H
+
+#include "um32_array.h"
+#include "um32_instruction.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// The JIT emits x86-64 machine code and is only available on that host
+//
+#if defined(__x86_64__) && defined(__GNUC__)
+#define UM32_JIT_SUPPORTED
+#endif
+
+// Maximum number of instructions translated into a single block
+//
+#define UM32_JIT_MAX_BLOCK_LENGTH 256
+
+// Flag set in the result of a block when the instruction at the returned
+// offset must be discharged by the interpreter before the next block runs
+//
+#define UM32_JIT_RESULT_INTERPRET (1ULL << 32)
+
+// A compiled basic block of the '0' array. The guest registers are read from
+// and written back to reg_a, and arrays_p is the base of the array table. The
+// low 32 bits of the result hold the offset of the next instruction to execute.
+//
+typedef uint64_t (*um32_jit_block_t)(uint32_t* reg_a, um32_array_pt arrays_p);
+
+typedef struct
+{
+    um32_jit_block_t  block_p;
+    uint32_t          length;
+} um32_jit_entry_t;
+typedef um32_jit_entry_t* um32_jit_entry_pt;
+
+// Structure holding the executable code buffer and the compiled block, if any,
+// starting at every offset of the '0' array
+//
+typedef struct
+{
+    uint8_t*           code_p;
+    size_t             codeSize;
+    size_t             codeUsed;
+    um32_jit_entry_pt  entries_p;
+    uint32_t           length;
+} um32_jit_t;
+typedef um32_jit_t* um32_jit_pt;
+
+um32_jit_pt um32_jit_create(uint32_t length);
+void um32_jit_free(um32_jit_pt jit_p);
+bool um32_jit_reset(um32_jit_pt jit_p, uint32_t length);
+um32_jit_block_t um32_jit_getBlock(um32_jit_pt jit_p,
+                                   const um32_instruction_t* decoded_p,
+                                   uint32_t offset);
+void um32_jit_invalidate(um32_jit_pt jit_p, uint32_t offset);
+
+#endif /* UM32_JIT_H */
@@ -28,29 +28,611 @@
 //******************************************************************************
 #include "um32_machine.h"
 
+#include "um32_jit.h"
 #include "um32_memory.h"
+#include "um32_profile.h"
 #include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
+#include <signal.h>
 #include <stdint.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
-//#define UM32_MACHINE_DEBUG_ENABLED
+// The direct-threaded engine relies on the labels-as-values extension. Define
+// UM32_MACHINE_ENGINE_SWITCH to build the portable switch engine instead, or
+// UM32_MACHINE_ENGINE_JIT to translate the program to native code on hosts the
+// JIT supports.
+//
+#if defined(UM32_MACHINE_ENGINE_JIT) && !defined(UM32_JIT_SUPPORTED)
+#undef UM32_MACHINE_ENGINE_JIT
+#endif
 
-#ifdef UM32_MACHINE_DEBUG_ENABLED
-#include <stdio.h>
-void
-um32_machine_logState(um32_machine_pt machine_p, um32_platter_t platter)
+// Compiled blocks cannot count or trace the instructions they execute or check
+// array bounds, so counting, profiling, checked and tracing builds interpret
+// the program instead. Profiling builds define UM32_MACHINE_PROFILE_ENABLED and
+// only collect a profile once it has been enabled with
+// um32_machine_enableProfile. Tracing builds define UM32_MACHINE_TRACE_ENABLED
+// and likewise wait for um32_machine_enableTrace.
+//
+#if defined(UM32_MACHINE_ENGINE_JIT) && \
+    (defined(UM32_MACHINE_COUNT_INSTRUCTIONS) || \
+     defined(UM32_MACHINE_PROFILE_ENABLED) || \
+     defined(UM32_MACHINE_CHECK_BOUNDS) || \
+     defined(UM32_MACHINE_TRACE_ENABLED))
+#undef UM32_MACHINE_ENGINE_JIT
+#endif
+
+// Checked builds define UM32_MACHINE_CHECK_BOUNDS. Array Index and Array
+// Amendment outside an active array, and Abandonment or Load Program of an
+// inactive one, then fail the machine instead of touching memory it does not
+// own. Other builds trust the program and compile the checks away.
+//
+#ifdef UM32_MACHINE_CHECK_BOUNDS
+#define UM32_MACHINE_CHECKED(condition) (condition)
+#else
+#define UM32_MACHINE_CHECKED(condition) (true)
+#endif
+
+#if defined(__GNUC__) && !defined(UM32_MACHINE_ENGINE_SWITCH) && \
+    !defined(UM32_MACHINE_ENGINE_JIT)
+#define UM32_MACHINE_ENGINE_THREADED
+#endif
+
+// Snapshot files start with this header, followed by the array table. They are
+// written in host byte order and only restored on hosts with the same order.
+//
+#define UM32_MACHINE_SNAPSHOT_MAGIC       "UM32SNAP"
+#define UM32_MACHINE_SNAPSHOT_VERSION     1
+#define UM32_MACHINE_SNAPSHOT_BYTE_ORDER  0x01020304
+
+typedef struct
 {
-    char buf[128];
-    um32_platter_toString(platter, buf);
+    char      magic_a[8];
+    uint32_t  version;
+    uint32_t  byteOrder;
+    uint32_t  reg_a[UM32_NUM_GENERAL_PURPOSE_REGISTERS];
+    uint32_t  executionFinger;
+    uint32_t  reserved;
+} um32_machine_snapshotHeader_t;
+
+// Set by um32_machine_requestSnapshot, which may be called from a signal
+// handler. The engines check it through um32_machine_requested before every
+// instruction or compiled block they discharge, and when Input is interrupted
+// while waiting for the console.
+//
+static volatile sig_atomic_t um32_machine_snapshotRequested = 0;
+
+// Set by um32_machine_requestSample, typically from a SIGPROF handler, and
+// serviced at the same points as snapshot requests
+//
+static volatile sig_atomic_t um32_machine_sampleRequested = 0;
+
+// Set along with either request, so that the engines only test one flag on
+// their fast paths
+//
+static volatile sig_atomic_t um32_machine_requested = 0;
 
-    uint32_t valA = um32_platter_toUInt32(machine_p->reg_a[platter.regA]);
-    uint32_t valB = um32_platter_toUInt32(machine_p->reg_a[platter.regB]);
-    uint32_t valC = um32_platter_toUInt32(machine_p->reg_a[platter.regC]);
-    printf("%s { valA = %u, valB = %u, valC = %u }\n", buf, valA, valB, valC);
+// Points the cached 0 array pointers at the array currently registered under
+// identifier 0, decoding it if it has not been loaded as a program before. The
+// execution finger keeps its offset.
+//
+static bool
+um32_machine_syncZeroArray(um32_machine_pt machine_p)
+{
+    size_t offset = (size_t)(machine_p->executionFinger_p - machine_p->zeroArray_p);
+
+    um32_instruction_pt decoded_p =
+        um32_array_table_decode(&(machine_p->arrayTable), 0);
+    if (decoded_p == NULL) { return false; }
+
+    um32_array_pt zeroArray_p = um32_array_table_get(&(machine_p->arrayTable), 0);
+    machine_p->zeroArray_p = zeroArray_p->platters_p;
+    machine_p->zeroArrayEnd_p = zeroArray_p->platters_p + zeroArray_p->length;
+    machine_p->zeroArrayDecoded_p = decoded_p;
+    machine_p->executionFinger_p = machine_p->zeroArray_p + offset;
+
+    // Give up on profiling rather than count past the end of the offsets
+    //
+    if ((machine_p->profile_p != NULL) &&
+        !um32_profile_resize(machine_p->profile_p, zeroArray_p->length))
+    {
+        printf("Unable to allocate memory for profile.\n");
+        um32_profile_free(machine_p->profile_p);
+        machine_p->profile_p = NULL;
+    }
+
+    return true;
 }
+
+// Starts collecting an execution profile. Returns false if this build does not
+// support profiling.
+//
+bool
+um32_machine_enableProfile(um32_machine_pt machine_p)
+{
+#ifdef UM32_MACHINE_PROFILE_ENABLED
+    if (machine_p->profile_p != NULL) { return true; }
+
+    machine_p->profile_p = um32_profile_create();
+    if (machine_p->profile_p == NULL) { return false; }
+
+    uint32_t length =
+        (uint32_t)(machine_p->zeroArrayEnd_p - machine_p->zeroArray_p);
+    if (!um32_profile_resize(machine_p->profile_p, length))
+    {
+        um32_profile_free(machine_p->profile_p);
+        machine_p->profile_p = NULL;
+        return false;
+    }
+
+    return true;
+#else
+    (void)machine_p;
+    return false;
+#endif
+}
+
+// Starts recording the last numRecords instructions, to be written to fileName
+// when the machine halts or fails. Returns false if this build does not
+// support tracing.
+//
+bool
+um32_machine_enableTrace(um32_machine_pt machine_p, const char* fileName,
+                         uint32_t numRecords)
+{
+#ifdef UM32_MACHINE_TRACE_ENABLED
+    if (machine_p->trace_p == NULL)
+    {
+        machine_p->trace_p = um32_trace_create(numRecords);
+        if (machine_p->trace_p == NULL) { return false; }
+    }
+    machine_p->traceName = fileName;
+
+    return true;
+#else
+    (void)machine_p;
+    (void)fileName;
+    (void)numRecords;
+    return false;
 #endif
+}
+
+// Starts counting samples of the execution finger, taken whenever
+// um32_machine_requestSample is called
+//
+bool
+um32_machine_enableSampling(um32_machine_pt machine_p)
+{
+    if (machine_p->sampler_p != NULL) { return true; }
+
+    machine_p->sampler_p = um32_sampler_create(
+        (uint32_t)(machine_p->zeroArrayEnd_p - machine_p->zeroArray_p));
+
+    return (machine_p->sampler_p != NULL);
+}
+
+// Writes the trace once the machine has stopped for good
+//
+static void
+um32_machine_saveTrace(um32_machine_pt machine_p)
+{
+    if ((machine_p->trace_p == NULL) ||
+        (machine_p->status == UM32_MACHINE_STATUS_RUNNING) ||
+        (machine_p->status == UM32_MACHINE_STATUS_NEEDS_INPUT) ||
+        (machine_p->status == UM32_MACHINE_STATUS_NEEDS_OUTPUT))
+    {
+        return;
+    }
+
+    if (!um32_trace_save(machine_p->trace_p, machine_p->traceName))
+    {
+        printf("Unable to write trace.\n");
+    }
+}
+
+// Prints the execution profile, if one has been collected
+//
+void
+um32_machine_printProfile(um32_machine_pt machine_p, FILE* file_p)
+{
+    if (machine_p->profile_p == NULL) { return; }
+
+    um32_profile_print(machine_p->profile_p, file_p,
+                       machine_p->zeroArrayDecoded_p,
+                       (uint32_t)(machine_p->zeroArrayEnd_p -
+                                  machine_p->zeroArray_p));
+}
+
+// Writes the contents of the output buffer to the console. Returns false if
+// the console would block before taking all of it, in which case the rest is
+// kept at the front of the buffer for the next flush.
+//
+bool
+um32_machine_flushOutput(um32_machine_pt machine_p)
+{
+    size_t written = 0;
+    while (written < machine_p->outputBufferUsed)
+    {
+        ssize_t result;
+        if (machine_p->writeCallback != NULL)
+        {
+            result = machine_p->writeCallback(machine_p->callbackContext_p,
+                                              machine_p->outputBuffer_a + written,
+                                              machine_p->outputBufferUsed - written);
+        }
+        else
+        {
+            result = write(machine_p->outputFd, machine_p->outputBuffer_a + written,
+                           machine_p->outputBufferUsed - written);
+        }
+        machine_p->stats.writeCalls++;
+        if (result <= 0)
+        {
+            if ((result == -1) && (machine_p->writeCallback == NULL) &&
+                (errno == EINTR))
+            {
+                continue;
+            }
+
+            // A non-blocking descriptor, such as one shared with
+            // non-blocking input, may not take everything at once. Leave the
+            // wait to the host rather than blocking its thread.
+            //
+            if (((result == UM32_MACHINE_IO_WOULD_BLOCK) &&
+                 (machine_p->writeCallback != NULL)) ||
+                ((result == -1) && (machine_p->writeCallback == NULL) &&
+                 ((errno == EAGAIN) || (errno == EWOULDBLOCK))))
+            {
+                memmove(machine_p->outputBuffer_a,
+                        machine_p->outputBuffer_a + written,
+                        machine_p->outputBufferUsed - written);
+                machine_p->outputBufferUsed -= written;
+                return false;
+            }
+            printf("Error writing to output.\n");
+            break;
+        }
+        written += (size_t)result;
+    }
+
+    machine_p->outputBufferUsed = 0;
+    return true;
+}
+
+// Writes the registers, the execution finger and every active array to the file
+// called name. The file is written under a temporary name and renamed into
+// place, so an existing snapshot is never left half written. Console input and
+// output are not part of the snapshot; pending output is flushed first.
+//
+bool
+um32_machine_saveSnapshot(um32_machine_pt machine_p, const char* name)
+{
+    um32_machine_flushOutput(machine_p);
+
+    size_t nameLength = strlen(name);
+    char* tempName = (char*)um32_memory_malloc(nameLength + 5);
+    if (tempName == NULL) { return false; }
+    memcpy(tempName, name, nameLength);
+    memcpy(tempName + nameLength, ".tmp", 5);
+
+    FILE* file_p = fopen(tempName, "wb");
+    if (file_p == NULL)
+    {
+        um32_memory_free(tempName);
+        return false;
+    }
+
+    um32_machine_snapshotHeader_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic_a, UM32_MACHINE_SNAPSHOT_MAGIC, sizeof(header.magic_a));
+    header.version = UM32_MACHINE_SNAPSHOT_VERSION;
+    header.byteOrder = UM32_MACHINE_SNAPSHOT_BYTE_ORDER;
+    for (int i=0; i<UM32_NUM_GENERAL_PURPOSE_REGISTERS; i++)
+    {
+        header.reg_a[i] = um32_platter_toUInt32(machine_p->reg_a[i]);
+    }
+    header.executionFinger =
+        (uint32_t)(machine_p->executionFinger_p - machine_p->zeroArray_p);
+
+    bool result = (fwrite(&header, sizeof(header), 1, file_p) == 1) &&
+                  um32_array_table_save(&(machine_p->arrayTable), file_p);
+    result = (fclose(file_p) == 0) && result;
+    result = result && (rename(tempName, name) == 0);
+    if (!result) { remove(tempName); }
+
+    um32_memory_free(tempName);
+
+    return result;
+}
+
+// Initializes a newly created machine from the snapshot file called name
+// instead of a program. The file is mapped and the arrays are copied straight
+// out of the mapping.
+//
+bool
+um32_machine_restoreSnapshot(um32_machine_pt machine_p, const char* name)
+{
+    int fd = open(name, O_RDONLY);
+    if (fd == -1) { return false; }
+
+    struct stat fileStat;
+    if ((fstat(fd, &fileStat) == -1) ||
+        ((size_t)fileStat.st_size < sizeof(um32_machine_snapshotHeader_t)))
+    {
+        close(fd);
+        return false;
+    }
+
+    size_t size = (size_t)fileStat.st_size;
+    void* mapped_p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped_p == MAP_FAILED) { return false; }
+    madvise(mapped_p, size, MADV_SEQUENTIAL);
+
+    const char* cur_p = (const char*)mapped_p;
+    const char* end_p = cur_p + size;
+
+    um32_machine_snapshotHeader_t header;
+    memcpy(&header, cur_p, sizeof(header));
+    cur_p += sizeof(header);
+
+    bool result =
+        (memcmp(header.magic_a, UM32_MACHINE_SNAPSHOT_MAGIC,
+                sizeof(header.magic_a)) == 0) &&
+        (header.version == UM32_MACHINE_SNAPSHOT_VERSION) &&
+        (header.byteOrder == UM32_MACHINE_SNAPSHOT_BYTE_ORDER) &&
+        um32_array_table_load(&(machine_p->arrayTable), &cur_p, end_p) &&
+        (cur_p == end_p);
+    munmap(mapped_p, size);
+    if (!result) { return false; }
+
+    for (int i=0; i<UM32_NUM_GENERAL_PURPOSE_REGISTERS; i++)
+    {
+        machine_p->reg_a[i] = um32_platter_fromUInt32(header.reg_a[i]);
+    }
+
+    um32_array_pt zeroArray_p = um32_array_table_get(&(machine_p->arrayTable), 0);
+    if (zeroArray_p->platters_p == NULL) { return false; }
+
+    machine_p->zeroArray_p = zeroArray_p->platters_p;
+    machine_p->executionFinger_p = zeroArray_p->platters_p +
+        ((header.executionFinger < zeroArray_p->length)
+         ? header.executionFinger
+         : zeroArray_p->length);
+
+    return um32_machine_syncZeroArray(machine_p);
+}
+
+// Names the file written when a snapshot is requested
+//
+void
+um32_machine_setSnapshotFile(um32_machine_pt machine_p, const char* name)
+{
+    machine_p->snapshotName = name;
+}
+
+// Asks the running machine to write a snapshot at the next opportunity. Safe to
+// call from a signal handler.
+//
+void
+um32_machine_requestSnapshot(void)
+{
+    um32_machine_snapshotRequested = 1;
+    um32_machine_requested = 1;
+}
+
+// Asks the running machine to sample its execution finger at the next
+// opportunity. Safe to call from a signal handler.
+//
+void
+um32_machine_requestSample(void)
+{
+    um32_machine_sampleRequested = 1;
+    um32_machine_requested = 1;
+}
+
+// Returns whether a snapshot or sample has been requested and not taken yet.
+// Read and write callbacks that wait for the console check it so that they can
+// return UM32_MACHINE_IO_WOULD_BLOCK and let the machine take it.
+//
+bool
+um32_machine_hasRequests(void)
+{
+    return (um32_machine_requested != 0);
+}
+
+// Writes the requested snapshot. The execution finger must point at the next
+// instruction to discharge.
+//
+static void
+um32_machine_takeRequestedSnapshot(um32_machine_pt machine_p)
+{
+    um32_machine_snapshotRequested = 0;
+    if (machine_p->snapshotName == NULL) { return; }
+
+    if (!um32_machine_saveSnapshot(machine_p, machine_p->snapshotName))
+    {
+        printf("Unable to write snapshot.\n");
+    }
+}
+
+// Takes the requested sample and snapshot, if any. The sample is counted at
+// sampledOffset, where the engine was interrupted, and the execution finger
+// must point at the next instruction to discharge.
+//
+static void
+um32_machine_serviceRequests(um32_machine_pt machine_p, uint32_t sampledOffset)
+{
+    um32_machine_requested = 0;
+
+    if (um32_machine_sampleRequested)
+    {
+        um32_machine_sampleRequested = 0;
+        if (machine_p->sampler_p != NULL)
+        {
+            um32_sampler_record(machine_p->sampler_p, sampledOffset);
+        }
+    }
+
+    if (um32_machine_snapshotRequested)
+    {
+        um32_machine_takeRequestedSnapshot(machine_p);
+    }
+}
+
+// Reads the next block of input into the input buffer. Returns the number of
+// bytes read, 0 once the end of input has been reached or
+// UM32_MACHINE_IO_WOULD_BLOCK if no input is available yet.
+//
+static ssize_t
+um32_machine_fillInput(um32_machine_pt machine_p)
+{
+    // A mapped input file is consumed in place and never refilled
+    //
+    if (machine_p->inputMapped_p != NULL) { return 0; }
+
+    for (;;)
+    {
+        ssize_t result;
+        if (machine_p->readCallback != NULL)
+        {
+            result = machine_p->readCallback(machine_p->callbackContext_p,
+                                             machine_p->inputBuffer_a,
+                                             UM32_MACHINE_INPUT_BUFFER_SIZE);
+        }
+        else
+        {
+            result = read(machine_p->inputFd, machine_p->inputBuffer_a,
+                          UM32_MACHINE_INPUT_BUFFER_SIZE);
+            if ((result == -1) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+            {
+                result = UM32_MACHINE_IO_WOULD_BLOCK;
+            }
+        }
+        machine_p->stats.readCalls++;
+
+        if (result > 0)
+        {
+            machine_p->inputCur_p = machine_p->inputBuffer_a;
+            machine_p->inputEnd_p = machine_p->inputBuffer_a + result;
+            return result;
+        }
+        if ((result == 0) || (result == UM32_MACHINE_IO_WOULD_BLOCK))
+        {
+            return result;
+        }
+        if ((machine_p->readCallback == NULL) && (errno == EINTR))
+        {
+            // The Input being discharged runs again once the snapshot is
+            // restored
+            //
+            if (um32_machine_snapshotRequested)
+            {
+                machine_p->executionFinger_p--;
+                um32_machine_takeRequestedSnapshot(machine_p);
+                machine_p->executionFinger_p++;
+            }
+            continue;
+        }
+        printf("Error reading from input.\n");
+        return 0;
+    }
+}
+
+// Selects the file descriptor Input reads from. Regular files are mapped into
+// memory when possible; anything else is read a block at a time. The caller
+// keeps ownership of fd.
+//
+bool
+um32_machine_setInput(um32_machine_pt machine_p, int fd)
+{
+    if ((machine_p == NULL) || (fd < 0)) { return false; }
+
+    if (machine_p->inputMapped_p != NULL)
+    {
+        munmap((void*)machine_p->inputMapped_p, machine_p->inputMappedSize);
+        machine_p->inputMapped_p = NULL;
+        machine_p->inputMappedSize = 0;
+    }
+
+    machine_p->inputFd = fd;
+    machine_p->readCallback = NULL;
+    machine_p->inputCur_p = machine_p->inputBuffer_a;
+    machine_p->inputEnd_p = machine_p->inputBuffer_a;
+
+    struct stat fileStat;
+    if ((fstat(fd, &fileStat) == 0) && S_ISREG(fileStat.st_mode) &&
+        (fileStat.st_size > 0))
+    {
+        void* mapped_p = mmap(NULL, (size_t)fileStat.st_size, PROT_READ,
+                              MAP_PRIVATE, fd, 0);
+        if (mapped_p != MAP_FAILED)
+        {
+            madvise(mapped_p, (size_t)fileStat.st_size, MADV_SEQUENTIAL);
+            machine_p->inputMapped_p = (const unsigned char*)mapped_p;
+            machine_p->inputMappedSize = (size_t)fileStat.st_size;
+            machine_p->inputCur_p = machine_p->inputMapped_p;
+            machine_p->inputEnd_p = machine_p->inputMapped_p +
+                                    machine_p->inputMappedSize;
+        }
+    }
+
+    return true;
+}
+
+// Hands console input and output to the host. Input already buffered or
+// mapped from a file is dropped and output still buffered is written to the
+// previous destination. um32_machine_setInput and um32_machine_setOutput
+// return to file descriptors.
+//
+void
+um32_machine_setCallbacks(um32_machine_pt machine_p,
+                          um32_machine_readCallback_t readCallback,
+                          um32_machine_writeCallback_t writeCallback,
+                          void* context_p)
+{
+    um32_machine_flushOutput(machine_p);
+
+    if (machine_p->inputMapped_p != NULL)
+    {
+        munmap((void*)machine_p->inputMapped_p, machine_p->inputMappedSize);
+        machine_p->inputMapped_p = NULL;
+        machine_p->inputMappedSize = 0;
+    }
+    machine_p->inputCur_p = machine_p->inputBuffer_a;
+    machine_p->inputEnd_p = machine_p->inputBuffer_a;
+
+    machine_p->readCallback = readCallback;
+    machine_p->writeCallback = writeCallback;
+    machine_p->callbackContext_p = context_p;
+}
+
+// Selects the file descriptor Output writes to. Anything still buffered for
+// the previous descriptor is written out first. The caller keeps ownership of
+// fd.
+//
+bool
+um32_machine_setOutput(um32_machine_pt machine_p, int fd)
+{
+    if ((machine_p == NULL) || (fd < 0)) { return false; }
+
+    um32_machine_flushOutput(machine_p);
+    machine_p->outputFd = fd;
+    machine_p->writeCallback = NULL;
+
+    return true;
+}
+
+void
+um32_machine_setOutputBuffering(um32_machine_pt machine_p,
+                                um32_machine_outputBuffering_t buffering)
+{
+    um32_machine_flushOutput(machine_p);
+    machine_p->outputBuffering = buffering;
+}
 
 um32_machine_pt
 um32_machine_create(void)
@@ -65,6 +647,22 @@ um32_machine_create(void)
     //
     memset(machine_p, 0, sizeof(um32_machine_t));
 
+    // Input is read from standard input and output written to standard output
+    // until told otherwise
+    //
+    machine_p->outputFd = 1;
+    machine_p->inputFd = 0;
+    machine_p->inputCur_p = machine_p->inputBuffer_a;
+    machine_p->inputEnd_p = machine_p->inputBuffer_a;
+
+    // Initialize the table of array identifiers
+    //
+    if (!um32_array_table_init(&(machine_p->arrayTable)))
+    {
+        um32_memory_free(machine_p);
+        return NULL;
+    }
+
     return machine_p;
 }
 
@@ -73,11 +671,106 @@ um32_machine_free(um32_machine_pt machine_p)
 {
     if (machine_p == NULL) { return; }
 
+    // Write out anything left in the output buffer
+    //
+    um32_machine_flushOutput(machine_p);
+
+    // Unmap the input file, if any
+    //
+    if (machine_p->inputMapped_p != NULL)
+    {
+        munmap((void*)machine_p->inputMapped_p, machine_p->inputMappedSize);
+    }
+
+    // Free all arrays of platters, including the 0 array
+    //
+    um32_array_table_free(&(machine_p->arrayTable));
+    um32_profile_free(machine_p->profile_p);
+    um32_trace_free(machine_p->trace_p);
+    um32_sampler_free(machine_p->sampler_p);
+
     // Free memory for um32
     //
     um32_memory_free(machine_p);
 }
 
+// Returns the number of platters in the program scroll in *length_p. Regular
+// files are sized with fstat so they can be mapped; anything else must at
+// least be seekable.
+//
+static bool
+um32_machine_measureProgram(FILE* file_p, uint32_t* length_p)
+{
+    struct stat fileStat;
+    long programSizeBytes;
+    if ((fstat(fileno(file_p), &fileStat) == 0) && S_ISREG(fileStat.st_mode))
+    {
+        programSizeBytes = (long)fileStat.st_size;
+    }
+    else
+    {
+        if (fseek(file_p, 0L, SEEK_END) != 0) { return false; }
+        if ((programSizeBytes = ftell(file_p)) == -1) { return false; }
+        if (fseek(file_p, 0L, SEEK_SET) != 0) { return false; }
+    }
+
+    *length_p = (uint32_t)(programSizeBytes / sizeof(um32_platter_t));
+
+    return true;
+}
+
+// Reads the first length platters of the program scroll into platters_p in
+// host byte order
+//
+static bool
+um32_machine_readProgram(FILE* file_p, um32_platter_pt platters_p,
+                         uint32_t length)
+{
+    int fd = fileno(file_p);
+    struct stat fileStat;
+    bool isRegularFile = (fstat(fd, &fileStat) == 0) && S_ISREG(fileStat.st_mode);
+    size_t bytesToRead = (size_t)length * sizeof(um32_platter_t);
+
+    // Map the program and endian swap it straight into the platters
+    //
+    void* mapped_p = MAP_FAILED;
+    if (isRegularFile && (bytesToRead > 0))
+    {
+        mapped_p = mmap(NULL, bytesToRead, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+
+    if (mapped_p != MAP_FAILED)
+    {
+        madvise(mapped_p, bytesToRead, MADV_SEQUENTIAL);
+        um32_platter_toHostByteOrderArray(platters_p, mapped_p, length);
+        munmap(mapped_p, bytesToRead);
+        return true;
+    }
+
+    // Otherwise read the program in large blocks, endian swapping each block
+    // as it arrives
+    //
+    char block_a[65536];
+    size_t bytesRead = 0;
+    if (fseek(file_p, 0L, SEEK_SET) != 0) { return false; }
+    while (bytesRead < bytesToRead)
+    {
+        size_t blockSize = bytesToRead - bytesRead;
+        if (blockSize > sizeof(block_a)) { blockSize = sizeof(block_a); }
+        if (fread(block_a, 1, blockSize, file_p) != blockSize)
+        {
+            return false;
+        }
+
+        um32_platter_toHostByteOrderArray(
+            platters_p + (bytesRead / sizeof(um32_platter_t)),
+            block_a, blockSize / sizeof(um32_platter_t));
+        bytesRead += blockSize;
+    }
+
+    return true;
+}
+
 //  The machine shall be initialized with a '0' array whose contents
 //  shall be read from a "program" scroll. All registers shall be
 //  initialized with platters of value '0'. The execution finger shall
@@ -88,45 +781,71 @@ um32_machine_init(um32_machine_pt machine_p, FILE* file_p)
 {
     if ((machine_p == NULL) || (file_p == NULL)) { return false; }
 
-    // Get the size of the program in bytes
+    // Allocate enough memory to store entire program under identifier 0
     //
-    long programSizeBytes;
-    if (fseek(file_p, 0L, SEEK_END) != 0) { return false; }
-    if ((programSizeBytes = ftell(file_p)) == -1) { return false; }
-    if (fseek(file_p, 0L, SEEK_SET) != 0) { return false; }
+    uint32_t length;
+    if (!um32_machine_measureProgram(file_p, &length)) { return false; }
+    if (!um32_array_table_replace(&(machine_p->arrayTable), 0, length))
+    {
+        return false;
+    }
 
-    // Allocate enough memory to store entire program
-    //
-    machine_p->zeroArray_p =
-        (um32_platter_pt)um32_memory_malloc((size_t)programSizeBytes);
-    if (machine_p->zeroArray_p == NULL) { return false; }
+    um32_platter_pt platters_p =
+        um32_array_table_get(&(machine_p->arrayTable), 0)->platters_p;
+    if (!um32_machine_readProgram(file_p, platters_p, length)) { return false; }
 
-    // Copies the entire program into the 0 array
+    // Point execution finger to start of 0 array and translate the program
+    // once so the Spin Cycle does not need to decode platters
     //
-    char* mem_p = (char*)(machine_p->zeroArray_p);
-    for (int i=0; i<programSizeBytes; i++)
+    machine_p->zeroArray_p = platters_p;
+    machine_p->executionFinger_p = platters_p;
+    if (!um32_machine_syncZeroArray(machine_p)) { return false; }
+
+    return true;
+}
+
+// Reads and decodes a program scroll once so that any number of machines, on
+// any number of threads, can be initialized from it with
+// um32_machine_initFromImage. Free the image with
+// um32_array_storage_freeShared after the last of those machines.
+//
+um32_array_storage_pt
+um32_machine_createImage(FILE* file_p)
+{
+    uint32_t length;
+    if ((file_p == NULL) || !um32_machine_measureProgram(file_p, &length))
     {
-        mem_p[i] = fgetc(file_p);
+        return NULL;
     }
 
-    // Save a pointer to the end of the 0 array
-    //
-    machine_p->zeroArrayEnd_p = (um32_platter_pt)(mem_p + programSizeBytes);
-
-    // Point execution finger to start of 0 array
-    //
-    machine_p->executionFinger_p = machine_p->zeroArray_p;
+    um32_array_storage_pt image_p = um32_array_storage_createShared(length);
+    if (image_p == NULL) { return NULL; }
 
-    // Endian swap all platters
-    //
-    um32_platter_pt curPlatter_p = machine_p->zeroArray_p;
-    while (curPlatter_p < machine_p->zeroArrayEnd_p)
+    if (!um32_machine_readProgram(file_p, image_p->platters_a, length) ||
+        !um32_array_storage_decodeShared(image_p))
     {
-        *curPlatter_p = um32_platter_toHostByteOrder(*curPlatter_p);
-        curPlatter_p++;
+        um32_array_storage_freeShared(image_p);
+        return NULL;
     }
 
-    return true;
+    return image_p;
+}
+
+// Initializes a machine with a program image as its 0 array. The image is
+// only copied if the machine amends it.
+//
+bool
+um32_machine_initFromImage(um32_machine_pt machine_p,
+                           um32_array_storage_pt image_p)
+{
+    if ((machine_p == NULL) || (image_p == NULL)) { return false; }
+
+    um32_array_table_attach(&(machine_p->arrayTable), 0, image_p);
+
+    machine_p->zeroArray_p = image_p->platters_a;
+    machine_p->executionFinger_p = image_p->platters_a;
+
+    return um32_machine_syncZeroArray(machine_p);
 }
 
 //  Standard Operators.
@@ -140,11 +859,11 @@ um32_machine_init(um32_machine_pt machine_p, FILE* file_p)
 //
 inline static void
 um32_machine_handleOperatorConditionalMove(um32_machine_pt machine_p,
-                                           um32_platter_t platter)
+                                           um32_instruction_t instruction)
 {
-    if (um32_platter_toUInt32(machine_p->reg_a[platter.regC]) != 0)
+    if (um32_platter_toUInt32(machine_p->reg_a[instruction.regC]) != 0)
     {
-        machine_p->reg_a[platter.regA] = machine_p->reg_a[platter.regB];
+        machine_p->reg_a[instruction.regA] = machine_p->reg_a[instruction.regB];
     }
 }
 
@@ -155,14 +874,21 @@ um32_machine_handleOperatorConditionalMove(um32_machine_pt machine_p,
 //
 inline static void
 um32_machine_handleOperatorArrayIndex(um32_machine_pt machine_p,
-                                      um32_platter_t platter)
+                                      um32_instruction_t instruction)
 {
-    uint32_t valB = um32_platter_toUInt32(machine_p->reg_a[platter.regB]);
-    uint32_t valC = um32_platter_toUInt32(machine_p->reg_a[platter.regC]);
-    um32_platter_pt array_p = valB ? (um32_platter_pt)(uintptr_t)valB
-                                   : machine_p->zeroArray_p;
+    uint32_t valB = um32_platter_toUInt32(machine_p->reg_a[instruction.regB]);
+    uint32_t valC = um32_platter_toUInt32(machine_p->reg_a[instruction.regC]);
+    if (!UM32_MACHINE_CHECKED(um32_array_table_isValidOffset(
+            &(machine_p->arrayTable), valB, valC)))
+    {
+        machine_p->status = UM32_MACHINE_STATUS_FAULT;
+        return;
+    }
 
-    machine_p->reg_a[platter.regA] = *(array_p + valC);
+    um32_platter_pt array_p =
+        um32_array_table_get(&(machine_p->arrayTable), valB)->platters_p;
+
+    machine_p->reg_a[instruction.regA] = *(array_p + valC);
 }
 
 //           #2. Array Amendment.
@@ -172,14 +898,33 @@ um32_machine_handleOperatorArrayIndex(um32_machine_pt machine_p,
 //
 inline static void
 um32_machine_handleOperatorArrayAmendment(um32_machine_pt machine_p,
-                                          um32_platter_t platter)
+                                          um32_instruction_t instruction)
 {
-    uint32_t valA = um32_platter_toUInt32(machine_p->reg_a[platter.regA]);
-    uint32_t valB = um32_platter_toUInt32(machine_p->reg_a[platter.regB]);
-    um32_platter_pt array_p = valA ? (um32_platter_pt)(uintptr_t)valA
-                                   : machine_p->zeroArray_p;
+    uint32_t valA = um32_platter_toUInt32(machine_p->reg_a[instruction.regA]);
+    uint32_t valB = um32_platter_toUInt32(machine_p->reg_a[instruction.regB]);
+    if (!UM32_MACHINE_CHECKED(um32_array_table_isValidOffset(
+            &(machine_p->arrayTable), valA, valB)))
+    {
+        machine_p->status = UM32_MACHINE_STATUS_FAULT;
+        return;
+    }
+
+    // Amending an array that shares its storage with another copies it first,
+    // and amending the 0 array also updates the decoded program
+    //
+    if (!um32_array_table_amend(&(machine_p->arrayTable), valA, valB,
+                                machine_p->reg_a[instruction.regC]))
+    {
+        printf("Unable to allocate memory for amended array.\n");
+        return;
+    }
 
-    *(array_p + valB) = machine_p->reg_a[platter.regC];
+    // The 0 array may have been given its own copy of the storage
+    //
+    if ((valA == 0) && !um32_machine_syncZeroArray(machine_p))
+    {
+        printf("Unable to allocate memory for amended array.\n");
+    }
 }
 
 //           #3. Addition.
@@ -189,12 +934,12 @@ um32_machine_handleOperatorArrayAmendment(um32_machine_pt machine_p,
 //
 inline static void
 um32_machine_handleOperatorAddition(um32_machine_pt machine_p,
-                                    um32_platter_t platter)
+                                    um32_instruction_t instruction)
 {
-    uint32_t valB = um32_platter_toUInt32(machine_p->reg_a[platter.regB]);
-    uint32_t valC = um32_platter_toUInt32(machine_p->reg_a[platter.regC]);
+    uint32_t valB = um32_platter_toUInt32(machine_p->reg_a[instruction.regB]);
+    uint32_t valC = um32_platter_toUInt32(machine_p->reg_a[instruction.regC]);
 
-    machine_p->reg_a[platter.regA] = um32_platter_fromUInt32(valB + valC);
+    machine_p->reg_a[instruction.regA] = um32_platter_fromUInt32(valB + valC);
 }
 
 //           #4. Multiplication.
@@ -204,12 +949,12 @@ um32_machine_handleOperatorAddition(um32_machine_pt machine_p,
 //
 inline static void
 um32_machine_handleOperatorMultiplication(um32_machine_pt machine_p,
-                                          um32_platter_t platter)
+                                          um32_instruction_t instruction)
 {
-    uint32_t valB = um32_platter_toUInt32(machine_p->reg_a[platter.regB]);
-    uint32_t valC = um32_platter_toUInt32(machine_p->reg_a[platter.regC]);
+    uint32_t valB = um32_platter_toUInt32(machine_p->reg_a[instruction.regB]);
+    uint32_t valC = um32_platter_toUInt32(machine_p->reg_a[instruction.regC]);
 
-    machine_p->reg_a[platter.regA] = um32_platter_fromUInt32(valB * valC);
+    machine_p->reg_a[instruction.regA] = um32_platter_fromUInt32(valB * valC);
 }
 
 //           #5. Division.
@@ -221,12 +966,20 @@ um32_machine_handleOperatorMultiplication(um32_machine_pt machine_p,
 //
 inline static void
 um32_machine_handleOperatorDivision(um32_machine_pt machine_p,
-                                    um32_platter_t platter)
+                                    um32_instruction_t instruction)
 {
-    uint32_t valB = um32_platter_toUInt32(machine_p->reg_a[platter.regB]);
-    uint32_t valC = um32_platter_toUInt32(machine_p->reg_a[platter.regC]);
+    uint32_t valB = um32_platter_toUInt32(machine_p->reg_a[instruction.regB]);
+    uint32_t valC = um32_platter_toUInt32(machine_p->reg_a[instruction.regC]);
+
+    // Dividing by zero fails the machine
+    //
+    if (valC == 0)
+    {
+        machine_p->status = UM32_MACHINE_STATUS_FAULT;
+        return;
+    }
 
-    machine_p->reg_a[platter.regA] = um32_platter_fromUInt32(valB / valC);
+    machine_p->reg_a[instruction.regA] = um32_platter_fromUInt32(valB / valC);
 }
 
 //           #6. Not-And.
@@ -238,12 +991,12 @@ um32_machine_handleOperatorDivision(um32_machine_pt machine_p,
 //
 inline static void
 um32_machine_handleOperatorNotAnd(um32_machine_pt machine_p,
-                                  um32_platter_t platter)
+                                  um32_instruction_t instruction)
 {
-    uint32_t valB = um32_platter_toUInt32(machine_p->reg_a[platter.regB]);
-    uint32_t valC = um32_platter_toUInt32(machine_p->reg_a[platter.regC]);
+    uint32_t valB = um32_platter_toUInt32(machine_p->reg_a[instruction.regB]);
+    uint32_t valC = um32_platter_toUInt32(machine_p->reg_a[instruction.regC]);
 
-    machine_p->reg_a[platter.regA] = um32_platter_fromUInt32(~(valB & valC));
+    machine_p->reg_a[instruction.regA] = um32_platter_fromUInt32(~(valB & valC));
 }
 
 //  Other Operators.
@@ -277,22 +1030,25 @@ um32_machine_handleOperatorHalt(void)
 //
 inline static void
 um32_machine_handleOperatorAllocation(um32_machine_pt machine_p,
-                                      um32_platter_t platter)
+                                      um32_instruction_t instruction)
 {
-    uint32_t valB = um32_platter_toUInt32(machine_p->reg_a[platter.regB]);
-    um32_platter_pt array_p = (um32_platter_pt)(uintptr_t)valB;
-    uint32_t valC = um32_platter_toUInt32(machine_p->reg_a[platter.regC]);
+    uint32_t valC = um32_platter_toUInt32(machine_p->reg_a[instruction.regC]);
+
+#ifdef UM32_MACHINE_PROFILE_ENABLED
+    if (machine_p->profile_p != NULL)
+    {
+        um32_profile_countAllocation(machine_p->profile_p, valC);
+    }
+#endif
 
-    size_t bytesToAlloc = (size_t)(valC * sizeof(um32_platter_t));
-    array_p = (um32_platter_pt)um32_memory_malloc(bytesToAlloc);
-    if (array_p == NULL)
+    uint32_t id = um32_array_table_allocate(&(machine_p->arrayTable), valC);
+    if (id == 0)
     {
         printf("Unable to allocate array of platters.\n");
         return;
     }
-    memset(array_p, 0, bytesToAlloc);
 
-    machine_p->reg_a[platter.regB] = um32_platter_fromUInt32((uintptr_t)(void*)array_p);
+    machine_p->reg_a[instruction.regB] = um32_platter_fromUInt32(id);
 }
 
 //           #9. Abandonment.
@@ -302,12 +1058,17 @@ um32_machine_handleOperatorAllocation(um32_machine_pt machine_p,
 //
 inline static void
 um32_machine_handleOperatorAbandonment(um32_machine_pt machine_p,
-                                       um32_platter_t platter)
+                                       um32_instruction_t instruction)
 {
-    uint32_t valC = um32_platter_toUInt32(machine_p->reg_a[platter.regC]);
-    um32_platter_pt array_p = (um32_platter_pt)(uintptr_t)valC;
+    uint32_t valC = um32_platter_toUInt32(machine_p->reg_a[instruction.regC]);
+    if (!UM32_MACHINE_CHECKED((valC != 0) &&
+            um32_array_table_isActive(&(machine_p->arrayTable), valC)))
+    {
+        machine_p->status = UM32_MACHINE_STATUS_FAULT;
+        return;
+    }
 
-    um32_memory_free(array_p);
+    um32_array_table_abandon(&(machine_p->arrayTable), valC);
 }
 
 //          #10. Output.
@@ -316,20 +1077,34 @@ um32_machine_handleOperatorAbandonment(um32_machine_pt machine_p,
 //                  immediately. Only values between and including 0 and 255
 //                  are allowed.
 //
+//                  Output is collected in the machine's output buffer, which
+//                  is flushed when it is full, at the end of each line in
+//                  line-buffered mode, before Input waits on the console and
+//                  when the machine stops. If the console would block, the
+//                  machine stops after this instruction until the host has
+//                  found it writable again.
+//
 inline static void
 um32_machine_handleOperatorOutput(um32_machine_pt machine_p,
-                                  um32_platter_t platter)
+                                  um32_instruction_t instruction)
 {
-    uint32_t valC = um32_platter_toUInt32(machine_p->reg_a[platter.regC]);
-    if (valC >= 255)
+    uint32_t valC = um32_platter_toUInt32(machine_p->reg_a[instruction.regC]);
+    if (valC > 255)
     {
         printf("Only values between and including 0 and 255 are allowed.\n");
         return;
     }
 
-    if (write(1, &(machine_p->reg_a[platter.regC]), 1) == -1)
+    machine_p->outputBuffer_a[machine_p->outputBufferUsed++] = (char)valC;
+
+    if ((machine_p->outputBufferUsed == UM32_MACHINE_OUTPUT_BUFFER_SIZE) ||
+        ((machine_p->outputBuffering == UM32_MACHINE_OUTPUT_LINE_BUFFERED) &&
+         (valC == '\n')))
     {
-        printf("Error writing to outpu.\n");
+        if (!um32_machine_flushOutput(machine_p))
+        {
+            machine_p->status = UM32_MACHINE_STATUS_NEEDS_OUTPUT;
+        }
     }
 }
 
@@ -344,11 +1119,41 @@ um32_machine_handleOperatorOutput(um32_machine_pt machine_p,
 //
 inline static void
 um32_machine_handleOperatorInput(um32_machine_pt machine_p,
-                                 um32_platter_t platter)
+                                 um32_instruction_t instruction)
 {
-    int input = getchar();
-    machine_p->reg_a[platter.regC] =
-        um32_platter_fromUInt32((input == EOF) ? 0xFFFFFFFF : (uint32_t)input);
+    // Input already buffered is consumed without touching the console.
+    // Otherwise anything written so far, such as a prompt, must be visible
+    // before waiting for more.
+    //
+    if (machine_p->inputCur_p == machine_p->inputEnd_p)
+    {
+        if (!um32_machine_flushOutput(machine_p))
+        {
+            machine_p->executionFinger_p--;
+            machine_p->status = UM32_MACHINE_STATUS_NEEDS_OUTPUT;
+            return;
+        }
+
+        ssize_t result = um32_machine_fillInput(machine_p);
+        if (result == UM32_MACHINE_IO_WOULD_BLOCK)
+        {
+            // Stop in front of this Input so it is discharged again once the
+            // host has more input
+            //
+            machine_p->executionFinger_p--;
+            machine_p->status = UM32_MACHINE_STATUS_NEEDS_INPUT;
+            return;
+        }
+        if (result == 0)
+        {
+            machine_p->reg_a[instruction.regC] =
+                um32_platter_fromUInt32(0xFFFFFFFF);
+            return;
+        }
+    }
+
+    machine_p->reg_a[instruction.regC] =
+        um32_platter_fromUInt32(*(machine_p->inputCur_p++));
 }
 
 //          #12. Load Program.
@@ -367,43 +1172,55 @@ um32_machine_handleOperatorInput(um32_machine_pt machine_p,
 //
 inline static void
 um32_machine_handleOperatorLoadProgram(um32_machine_pt machine_p,
-                                       um32_platter_t platter)
+                                       um32_instruction_t instruction)
 {
-    // Update execution finger. This needs to be done regardless of whether or
-    // not the source array exists so this operator can act as a jump.
+    // Get source array. Loading the 0 array is a jump, so nothing is loaded.
     //
-    uint32_t valC = um32_platter_toUInt32(machine_p->reg_a[platter.regC]);
-    machine_p->executionFinger_p = machine_p->zeroArray_p + valC;
+    uint32_t valB = um32_platter_toUInt32(machine_p->reg_a[instruction.regB]);
 
-    // Get source array and size of source array
-    //
-    uint32_t valB = um32_platter_toUInt32(machine_p->reg_a[platter.regB]);
-    um32_platter_pt srcArray_p = (um32_platter_pt)(uintptr_t)valB;
-    if (srcArray_p == NULL)
+#ifdef UM32_MACHINE_PROFILE_ENABLED
+    if (machine_p->profile_p != NULL)
     {
-        //printf("Loading from an unallocated array.\n");
-        return;
+        um32_profile_countLoadProgram(machine_p->profile_p, valB);
     }
+#endif
 
-    // Reallocate enough memory to store new program
-    //
-    size_t srcArraySize = um32_memory_malloc_usable_size(srcArray_p);
-    machine_p->zeroArray_p =
-        (um32_platter_pt)um32_memory_realloc(machine_p->zeroArray_p,
-                                             srcArraySize);
-    if (machine_p->zeroArray_p == NULL)
+    if (!UM32_MACHINE_CHECKED(
+            um32_array_table_isActive(&(machine_p->arrayTable), valB)))
     {
-        printf("Unable to allocate memory for new program.\n");
+        machine_p->status = UM32_MACHINE_STATUS_FAULT;
         return;
     }
 
-    // Copies new program into 0 array
-    //
-    memcpy(machine_p->zeroArray_p, srcArray_p, srcArraySize);
+    if (valB != 0)
+    {
+        // Translate the new program unless it has been loaded before
+        //
+        if (um32_array_table_decode(&(machine_p->arrayTable), valB) == NULL)
+        {
+            printf("Unable to allocate memory for new program.\n");
+            machine_p->executionFinger_p = machine_p->zeroArrayEnd_p;
+            return;
+        }
+
+        // The 0 array shares the storage of the source array, which is only
+        // copied once either of them is amended
+        //
+        um32_array_table_share(&(machine_p->arrayTable), 0, valB);
+        um32_machine_syncZeroArray(machine_p);
+
+        if (machine_p->sampler_p != NULL)
+        {
+            um32_sampler_beginGeneration(machine_p->sampler_p, valB,
+                (uint32_t)(machine_p->zeroArrayEnd_p - machine_p->zeroArray_p));
+        }
+    }
 
-    // Update pointer to end of 0 array
+    // Update execution finger. This is done after the 0 array has been
+    // replaced so the finger never points into the old program.
     //
-    machine_p->zeroArrayEnd_p = machine_p->zeroArray_p + srcArraySize;
+    uint32_t valC = um32_platter_toUInt32(machine_p->reg_a[instruction.regC]);
+    machine_p->executionFinger_p = machine_p->zeroArray_p + valC;
 }
 
 //  Special Operators.
@@ -417,9 +1234,9 @@ um32_machine_handleOperatorLoadProgram(um32_machine_pt machine_p,
 //
 inline static void
 um32_machine_handleOperatorOrthography(um32_machine_pt machine_p,
-                                       um32_platter_special_t platter)
+                                       um32_instruction_t instruction)
 {
-    machine_p->reg_a[platter.regA] = um32_platter_fromUInt32(platter.value);
+    machine_p->reg_a[instruction.regA] = um32_platter_fromUInt32(instruction.value);
 }
 
 //  Once initialized, the machine begins its Spin Cycle. In each cycle
@@ -428,62 +1245,756 @@ um32_machine_handleOperatorOrthography(um32_machine_pt machine_p,
 //  is discharged, the execution finger shall be advanced to the next
 //  platter, if any.
 //
-void
-um32_machine_run(um32_machine_pt machine_p)
+//  The switch engine funnels every operator through a single switch and keeps
+//  all state in the machine structure. A single cycle returns false once the
+//  machine has stopped, leaving the reason in its status. Running off the end
+//  of the 0 array fails the machine.
+//
+inline static bool
+um32_machine_step(um32_machine_pt machine_p)
+{
+    if (machine_p->executionFinger_p >= machine_p->zeroArrayEnd_p)
+    {
+        machine_p->status = UM32_MACHINE_STATUS_FAULT;
+        return false;
+    }
+
+    uint32_t offset =
+        (uint32_t)(machine_p->executionFinger_p - machine_p->zeroArray_p);
+    if (um32_machine_requested)
+    {
+        um32_machine_serviceRequests(machine_p, offset);
+    }
+
+#ifdef UM32_MACHINE_COUNT_INSTRUCTIONS
+    machine_p->stats.instructions++;
+#endif
+
+#ifdef UM32_MACHINE_TRACE_ENABLED
+    if (machine_p->trace_p != NULL)
+    {
+        um32_trace_record(machine_p->trace_p, offset,
+                          um32_platter_toUInt32(*(machine_p->executionFinger_p)),
+                          (const uint32_t*)(void*)machine_p->reg_a);
+    }
+#endif
+    um32_instruction_t curInstruction = machine_p->zeroArrayDecoded_p[offset];
+    machine_p->executionFinger_p++;
+
+#ifdef UM32_MACHINE_PROFILE_ENABLED
+    if (machine_p->profile_p != NULL)
+    {
+        um32_profile_countInstruction(machine_p->profile_p,
+            um32_instruction_baseOperator(curInstruction.operatorNum), offset);
+    }
+#endif
+
+    // Superinstructions are discharged one instruction at a time, as their
+    // base operator
+    //
+    switch(curInstruction.operatorNum)
+    {
+    case UM32_OPERATOR_CONDITIONAL_MOVE:
+        um32_machine_handleOperatorConditionalMove(machine_p, curInstruction);
+        break;
+    case UM32_OPERATOR_ARRAY_INDEX:
+        um32_machine_handleOperatorArrayIndex(machine_p, curInstruction);
+        break;
+    case UM32_OPERATOR_ARRAY_AMENDMENT:
+        um32_machine_handleOperatorArrayAmendment(machine_p, curInstruction);
+        break;
+    case UM32_OPERATOR_ADDITION:
+        um32_machine_handleOperatorAddition(machine_p, curInstruction);
+        break;
+    case UM32_OPERATOR_MULTIPLICATION:
+        um32_machine_handleOperatorMultiplication(machine_p, curInstruction);
+        break;
+    case UM32_OPERATOR_DIVISION:
+        um32_machine_handleOperatorDivision(machine_p, curInstruction);
+        break;
+    case UM32_OPERATOR_NOT_AND:
+    case UM32_INSTRUCTION_OPERATOR_NOT_AND_PAIR:
+        um32_machine_handleOperatorNotAnd(machine_p, curInstruction);
+        break;
+    case UM32_OPERATOR_HALT:
+        um32_machine_handleOperatorHalt();
+        machine_p->status = UM32_MACHINE_STATUS_HALTED;
+        return false;
+    case UM32_OPERATOR_ALLOCATION:
+        um32_machine_handleOperatorAllocation(machine_p, curInstruction);
+        break;
+    case UM32_OPERATOR_ABANDONMENT:
+        um32_machine_handleOperatorAbandonment(machine_p, curInstruction);
+        break;
+    case UM32_OPERATOR_OUTPUT:
+        um32_machine_handleOperatorOutput(machine_p, curInstruction);
+        break;
+    case UM32_OPERATOR_INPUT:
+        um32_machine_handleOperatorInput(machine_p, curInstruction);
+        break;
+    case UM32_OPERATOR_LOAD_PROGRAM:
+        um32_machine_handleOperatorLoadProgram(machine_p, curInstruction);
+        break;
+    case UM32_OPERATOR_ORTHOGRAPHY:
+    case UM32_INSTRUCTION_OPERATOR_ORTHOGRAPHY_PAIR:
+    case UM32_INSTRUCTION_OPERATOR_ORTHOGRAPHY_LOAD_PROGRAM:
+        um32_machine_handleOperatorOrthography(machine_p, curInstruction);
+        break;
+    }
+
+    return machine_p->status == UM32_MACHINE_STATUS_RUNNING;
+}
+
+// Clears a request for input or output before running again. Output the
+// console would not take is written out first, but output merely buffered by a
+// running machine is left for its next flush, so that discharging one
+// instruction at a time does not write every byte on its own. Returns false
+// if the console still would block, or if the machine has halted or failed
+// for good.
+//
+static bool
+um32_machine_resume(um32_machine_pt machine_p)
+{
+    if ((machine_p->status != UM32_MACHINE_STATUS_RUNNING) &&
+        (machine_p->status != UM32_MACHINE_STATUS_NEEDS_INPUT) &&
+        !um32_machine_flushOutput(machine_p))
+    {
+        return false;
+    }
+
+    if ((machine_p->status == UM32_MACHINE_STATUS_NEEDS_INPUT) ||
+        (machine_p->status == UM32_MACHINE_STATUS_NEEDS_OUTPUT))
+    {
+        machine_p->status = UM32_MACHINE_STATUS_RUNNING;
+    }
+
+    return machine_p->status == UM32_MACHINE_STATUS_RUNNING;
+}
+
+// Status to report to the host once a run is over. A machine that halted or
+// failed with output the console would not take yet still needs output.
+//
+static um32_machine_status_t
+um32_machine_reportStatus(um32_machine_pt machine_p)
+{
+    return (machine_p->outputBufferUsed > 0)
+        ? UM32_MACHINE_STATUS_NEEDS_OUTPUT
+        : machine_p->status;
+}
+
+// Discharges at most numInstructions instructions with the switch engine and
+// writes out any buffered output. Returns UM32_MACHINE_STATUS_RUNNING if the
+// budget ran out first.
+//
+um32_machine_status_t
+um32_machine_runFor(um32_machine_pt machine_p, uint64_t numInstructions)
 {
-    while (machine_p->executionFinger_p < machine_p->zeroArrayEnd_p)
+    if (!um32_machine_resume(machine_p))
+    {
+        return um32_machine_reportStatus(machine_p);
+    }
+
+    for (uint64_t i=0; i<numInstructions; i++)
     {
-        um32_platter_t curPlatter = *(machine_p->executionFinger_p++);
+        if (!um32_machine_step(machine_p)) { break; }
+    }
+
+    um32_machine_flushOutput(machine_p);
+    um32_machine_saveTrace(machine_p);
+
+    return um32_machine_reportStatus(machine_p);
+}
+
+// Discharges the single instruction under the execution finger with the switch
+// engine, leaving any output buffered. Returns false once the machine has
+// stopped. Lets translated programs hand the interpreter the instructions they
+// do not implement themselves.
+//
+bool
+um32_machine_discharge(um32_machine_pt machine_p)
+{
+    if (!um32_machine_resume(machine_p)) { return false; }
+
+    return um32_machine_step(machine_p);
+}
 
-#ifdef UM32_MACHINE_DEBUG_ENABLED
-        um32_machine_logState(machine_p, curPlatter);
+#ifndef UM32_MACHINE_ENGINE_THREADED
+static void
+um32_machine_runSwitch(um32_machine_pt machine_p)
+{
+    while (um32_machine_step(machine_p)) {}
+}
 #endif
 
-        switch(curPlatter.operatorNum)
+#ifdef UM32_MACHINE_ENGINE_JIT
+//  The JIT engine runs compiled basic blocks of the 0 array and discharges
+//  every instruction the blocks leave behind (Halt, Allocation, Abandonment,
+//  Output, Input, loads from other arrays and amendments to the 0 array) with
+//  a single interpreter cycle. Blocks covering an amended platter are dropped,
+//  and loading a new program throws all of them away.
+//
+static void
+um32_machine_runJit(um32_machine_pt machine_p)
+{
+    uint32_t length =
+        (uint32_t)(machine_p->zeroArrayEnd_p - machine_p->zeroArray_p);
+    um32_jit_pt jit_p = um32_jit_create(length);
+    if (jit_p == NULL)
+    {
+        um32_machine_runSwitch(machine_p);
+        return;
+    }
+
+    // The blocks read and write the registers in place
+    //
+    uint32_t* reg_a = (uint32_t*)(void*)machine_p->reg_a;
+
+    for (;;)
+    {
+        uint32_t offset =
+            (uint32_t)(machine_p->executionFinger_p - machine_p->zeroArray_p);
+        if (offset >= length)
         {
-        case UM32_OPERATOR_CONDITIONAL_MOVE:
-            um32_machine_handleOperatorConditionalMove(machine_p, curPlatter);
-            break;
-        case UM32_OPERATOR_ARRAY_INDEX:
-            um32_machine_handleOperatorArrayIndex(machine_p, curPlatter);
-            break;
-        case UM32_OPERATOR_ARRAY_AMENDMENT:
-            um32_machine_handleOperatorArrayAmendment(machine_p, curPlatter);
-            break;
-        case UM32_OPERATOR_ADDITION:
-            um32_machine_handleOperatorAddition(machine_p, curPlatter);
-            break;
-        case UM32_OPERATOR_MULTIPLICATION:
-            um32_machine_handleOperatorMultiplication(machine_p, curPlatter);
-            break;
-        case UM32_OPERATOR_DIVISION:
-            um32_machine_handleOperatorDivision(machine_p, curPlatter);
-            break;
-        case UM32_OPERATOR_NOT_AND:
-            um32_machine_handleOperatorNotAnd(machine_p, curPlatter);
-            break;
-        case UM32_OPERATOR_HALT:
-            um32_machine_handleOperatorHalt();
-            return;
-        case UM32_OPERATOR_ALLOCATION:
-            um32_machine_handleOperatorAllocation(machine_p, curPlatter);
-            break;
-        case UM32_OPERATOR_ABANDONMENT:
-            um32_machine_handleOperatorAbandonment(machine_p, curPlatter);
-            break;
-        case UM32_OPERATOR_OUTPUT:
-            um32_machine_handleOperatorOutput(machine_p, curPlatter);
-            break;
-        case UM32_OPERATOR_INPUT:
-            um32_machine_handleOperatorInput(machine_p, curPlatter);
-            break;
-        case UM32_OPERATOR_LOAD_PROGRAM:
-            um32_machine_handleOperatorLoadProgram(machine_p, curPlatter);
-            break;
-        case UM32_OPERATOR_ORTHOGRAPHY:
-            um32_machine_handleOperatorOrthography(machine_p,
-                    um32_platter_special_fromPlatter(curPlatter));
+            machine_p->status = UM32_MACHINE_STATUS_FAULT;
             break;
         }
+
+        if (um32_machine_requested)
+        {
+            um32_machine_serviceRequests(machine_p, offset);
+        }
+
+        // A request that arrives while a block runs is serviced as soon as it
+        // returns, and the sample is counted against the start of the block
+        //
+        um32_jit_block_t block_p =
+            um32_jit_getBlock(jit_p, machine_p->zeroArrayDecoded_p, offset);
+        if (block_p != NULL)
+        {
+            uint32_t blockOffset = offset;
+            uint64_t result = block_p(reg_a, machine_p->arrayTable.arrays_p);
+            offset = (uint32_t)result;
+            machine_p->executionFinger_p = machine_p->zeroArray_p + offset;
+            if (um32_machine_requested)
+            {
+                um32_machine_serviceRequests(machine_p, blockOffset);
+            }
+            if (!(result & UM32_JIT_RESULT_INTERPRET)) { continue; }
+        }
+
+        // Note what the instruction is about to change before discharging it
+        //
+        um32_instruction_t instruction = machine_p->zeroArrayDecoded_p[offset];
+        bool amendsProgram =
+            (instruction.operatorNum == UM32_OPERATOR_ARRAY_AMENDMENT) &&
+            (reg_a[instruction.regA] == 0);
+        uint32_t amendedOffset = reg_a[instruction.regB];
+        um32_platter_pt zeroArray_p = machine_p->zeroArray_p;
+
+        if (!um32_machine_step(machine_p)) { break; }
+
+        // Loading the array that the 0 array already shares keeps the program
+        // and every compiled block
+        //
+        if (amendsProgram)
+        {
+            um32_jit_invalidate(jit_p, amendedOffset);
+        }
+        else if ((instruction.operatorNum == UM32_OPERATOR_LOAD_PROGRAM) &&
+                 (machine_p->zeroArray_p != zeroArray_p))
+        {
+            length = (uint32_t)(machine_p->zeroArrayEnd_p - machine_p->zeroArray_p);
+            if (!um32_jit_reset(jit_p, length))
+            {
+                // Finish the run in the interpreter
+                //
+                um32_jit_free(jit_p);
+                um32_machine_runSwitch(machine_p);
+                return;
+            }
+        }
+    }
+
+    um32_jit_free(jit_p);
+}
+#endif
+
+#ifdef UM32_MACHINE_ENGINE_THREADED
+//  The direct-threaded engine jumps straight from the end of each operator to
+//  the next one through a table of label addresses, giving every operator its
+//  own indirect branch. The registers and the execution finger are held in
+//  locals for the whole run and are only written back to the machine around
+//  operators that are implemented by the handlers above. The finger walks the
+//  decoded program, whose end sentinel stops the machine, so no bounds check
+//  is needed per instruction. Superinstructions discharge the next instruction
+//  as well before dispatching again.
+//
+//  Builds with UM32_INSTRUCTION_SPECIALIZED_HANDLERS defined dispatch each
+//  instruction on the handler selected when it was decoded. Besides the
+//  generic handler of every operator, the arithmetic and logic operators then
+//  have one handler for every combination of registers, and Orthography one
+//  for every register A, so that the common instructions index the registers
+//  with constants. They are generated by the macros below, which expand M once
+//  per register number.
+//
+#define UM32_MACHINE_EACH_REGISTER(M, ...)                                     \
+    M(__VA_ARGS__, 0) M(__VA_ARGS__, 1) M(__VA_ARGS__, 2) M(__VA_ARGS__, 3)    \
+    M(__VA_ARGS__, 4) M(__VA_ARGS__, 5) M(__VA_ARGS__, 6) M(__VA_ARGS__, 7)
+
+#define UM32_MACHINE_EACH_REGISTER_C(M, op, a, b)                              \
+    M(op, a, b, 0) M(op, a, b, 1) M(op, a, b, 2) M(op, a, b, 3)                \
+    M(op, a, b, 4) M(op, a, b, 5) M(op, a, b, 6) M(op, a, b, 7)
+
+#define UM32_MACHINE_EACH_REGISTER_B(M, op, a)                                 \
+    UM32_MACHINE_EACH_REGISTER_C(M, op, a, 0)                                  \
+    UM32_MACHINE_EACH_REGISTER_C(M, op, a, 1)                                  \
+    UM32_MACHINE_EACH_REGISTER_C(M, op, a, 2)                                  \
+    UM32_MACHINE_EACH_REGISTER_C(M, op, a, 3)                                  \
+    UM32_MACHINE_EACH_REGISTER_C(M, op, a, 4)                                  \
+    UM32_MACHINE_EACH_REGISTER_C(M, op, a, 5)                                  \
+    UM32_MACHINE_EACH_REGISTER_C(M, op, a, 6)                                  \
+    UM32_MACHINE_EACH_REGISTER_C(M, op, a, 7)
+
+#define UM32_MACHINE_EACH_REGISTERS(M, op)                                     \
+    UM32_MACHINE_EACH_REGISTER_B(M, op, 0)                                     \
+    UM32_MACHINE_EACH_REGISTER_B(M, op, 1)                                     \
+    UM32_MACHINE_EACH_REGISTER_B(M, op, 2)                                     \
+    UM32_MACHINE_EACH_REGISTER_B(M, op, 3)                                     \
+    UM32_MACHINE_EACH_REGISTER_B(M, op, 4)                                     \
+    UM32_MACHINE_EACH_REGISTER_B(M, op, 5)                                     \
+    UM32_MACHINE_EACH_REGISTER_B(M, op, 6)                                     \
+    UM32_MACHINE_EACH_REGISTER_B(M, op, 7)
+
+#define UM32_MACHINE_SPECIALIZED_LABEL(op, a, b, c)                            \
+    &&specialized##op##_##a##_##b##_##c,
+
+#define UM32_MACHINE_ORTHOGRAPHY_LABEL(op, a)                                  \
+    &&specialized##op##_##a,
+
+static void
+um32_machine_runThreaded(um32_machine_pt machine_p)
+{
+    static void* const handlerLabels_a[UM32_INSTRUCTION_NUM_HANDLERS] =
+    {
+        &&operatorConditionalMove,
+        &&operatorArrayIndex,
+        &&operatorArrayAmendment,
+        &&operatorAddition,
+        &&operatorMultiplication,
+        &&operatorDivision,
+        &&operatorNotAnd,
+        &&operatorHalt,
+        &&operatorAllocation,
+        &&operatorAbandonment,
+        &&operatorOutput,
+        &&operatorInput,
+        &&operatorLoadProgram,
+        &&operatorOrthography,
+        &&operatorInvalid,
+        &&operatorInvalid,
+        &&operatorEnd,
+        &&operatorOrthographyPair,
+        &&operatorNotAndPair,
+        &&operatorOrthographyLoadProgram,
+#ifdef UM32_INSTRUCTION_SPECIALIZED_HANDLERS
+        UM32_MACHINE_EACH_REGISTERS(UM32_MACHINE_SPECIALIZED_LABEL,
+                                    CONDITIONAL_MOVE)
+        UM32_MACHINE_EACH_REGISTERS(UM32_MACHINE_SPECIALIZED_LABEL, ADDITION)
+        UM32_MACHINE_EACH_REGISTERS(UM32_MACHINE_SPECIALIZED_LABEL,
+                                    MULTIPLICATION)
+        UM32_MACHINE_EACH_REGISTERS(UM32_MACHINE_SPECIALIZED_LABEL, DIVISION)
+        UM32_MACHINE_EACH_REGISTERS(UM32_MACHINE_SPECIALIZED_LABEL, NOT_AND)
+        UM32_MACHINE_EACH_REGISTER(UM32_MACHINE_ORTHOGRAPHY_LABEL, ORTHOGRAPHY)
+#endif
+    };
+
+    uint32_t reg_a[UM32_NUM_GENERAL_PURPOSE_REGISTERS];
+    um32_instruction_pt decoded_p;
+    uint32_t length;
+    um32_instruction_pt executionFinger_p;
+    um32_instruction_t curInstruction;
+
+#define UM32_MACHINE_LOAD_STATE()                                              \
+    do                                                                         \
+    {                                                                          \
+        for (int i=0; i<UM32_NUM_GENERAL_PURPOSE_REGISTERS; i++)               \
+        {                                                                      \
+            reg_a[i] = um32_platter_toUInt32(machine_p->reg_a[i]);             \
+        }                                                                      \
+        decoded_p = machine_p->zeroArrayDecoded_p;                             \
+        length = (uint32_t)(machine_p->zeroArrayEnd_p -                        \
+                            machine_p->zeroArray_p);                           \
+        size_t offset = (size_t)(machine_p->executionFinger_p -                \
+                                 machine_p->zeroArray_p);                      \
+        executionFinger_p = decoded_p + ((offset < length) ? offset : length); \
+    } while (0)
+
+#define UM32_MACHINE_SAVE_STATE()                                              \
+    do                                                                         \
+    {                                                                          \
+        for (int i=0; i<UM32_NUM_GENERAL_PURPOSE_REGISTERS; i++)               \
+        {                                                                      \
+            machine_p->reg_a[i] = um32_platter_fromUInt32(reg_a[i]);           \
+        }                                                                      \
+        machine_p->executionFinger_p =                                         \
+            machine_p->zeroArray_p + (executionFinger_p - decoded_p);          \
+    } while (0)
+
+#ifdef UM32_MACHINE_TRACE_ENABLED
+#define UM32_MACHINE_TRACE_INSTRUCTION()                                       \
+    do                                                                         \
+    {                                                                          \
+        if (machine_p->trace_p != NULL)                                        \
+        {                                                                      \
+            uint32_t offset = (uint32_t)(executionFinger_p - decoded_p - 1);   \
+            um32_trace_record(machine_p->trace_p, offset,                      \
+                um32_platter_toUInt32(machine_p->zeroArray_p[offset]), reg_a); \
+        }                                                                      \
+    } while (0)
+#else
+#define UM32_MACHINE_TRACE_INSTRUCTION()
+#endif
+
+#ifdef UM32_MACHINE_COUNT_INSTRUCTIONS
+#define UM32_MACHINE_COUNT_INSTRUCTION()                                       \
+    do                                                                         \
+    {                                                                          \
+        machine_p->stats.instructions++;                                       \
+    } while (0)
+#else
+#define UM32_MACHINE_COUNT_INSTRUCTION()
+#endif
+
+#ifdef UM32_MACHINE_PROFILE_ENABLED
+#define UM32_MACHINE_PROFILE_INSTRUCTION(operatorNum)                          \
+    do                                                                         \
+    {                                                                          \
+        if (machine_p->profile_p != NULL)                                      \
+        {                                                                      \
+            um32_profile_countInstruction(machine_p->profile_p, operatorNum,   \
+                (uint32_t)(executionFinger_p - decoded_p - 1));                \
+        }                                                                      \
+    } while (0)
+#else
+#define UM32_MACHINE_PROFILE_INSTRUCTION(operatorNum)
+#endif
+
+#ifdef UM32_INSTRUCTION_SPECIALIZED_HANDLERS
+#define UM32_MACHINE_HANDLER(instruction) ((instruction).handler)
+#else
+#define UM32_MACHINE_HANDLER(instruction) ((instruction).operatorNum)
+#endif
+
+#define UM32_MACHINE_DISPATCH()                                                \
+    do                                                                         \
+    {                                                                          \
+        if (um32_machine_requested) { goto serviceRequests; }                  \
+        curInstruction = *(executionFinger_p++);                               \
+        UM32_MACHINE_TRACE_INSTRUCTION();                                      \
+        UM32_MACHINE_COUNT_INSTRUCTION();                                      \
+        UM32_MACHINE_PROFILE_INSTRUCTION(curInstruction.operatorNum);          \
+        goto *handlerLabels_a[UM32_MACHINE_HANDLER(curInstruction)];           \
+    } while (0)
+
+// Fetches the second instruction of a superinstruction, which the handler
+// discharges without dispatching on it
+//
+#define UM32_MACHINE_FETCH_SECOND()                                            \
+    do                                                                         \
+    {                                                                          \
+        curInstruction = *(executionFinger_p++);                               \
+        UM32_MACHINE_TRACE_INSTRUCTION();                                      \
+        UM32_MACHINE_COUNT_INSTRUCTION();                                      \
+        UM32_MACHINE_PROFILE_INSTRUCTION(                                      \
+            um32_instruction_baseOperator(curInstruction.operatorNum));        \
+    } while (0)
+
+// Bodies of the specialized handlers, which repeat the generic handlers on the
+// fixed registers a, b and c
+//
+#define UM32_MACHINE_CONDITIONAL_MOVE(a, b, c)                                 \
+    if (reg_a[c] != 0) { reg_a[a] = reg_a[b]; }
+
+#define UM32_MACHINE_ADDITION(a, b, c)                                         \
+    reg_a[a] = reg_a[b] + reg_a[c];
+
+#define UM32_MACHINE_MULTIPLICATION(a, b, c)                                   \
+    reg_a[a] = reg_a[b] * reg_a[c];
+
+#define UM32_MACHINE_DIVISION(a, b, c)                                         \
+    if (reg_a[c] == 0)                                                         \
+    {                                                                          \
+        machine_p->status = UM32_MACHINE_STATUS_FAULT;                         \
+        goto finished;                                                         \
+    }                                                                          \
+    reg_a[a] = reg_a[b] / reg_a[c];
+
+#define UM32_MACHINE_NOT_AND(a, b, c)                                          \
+    reg_a[a] = ~(reg_a[b] & reg_a[c]);
+
+#define UM32_MACHINE_SPECIALIZED_HANDLER(op, a, b, c)                          \
+specialized##op##_##a##_##b##_##c:                                             \
+    UM32_MACHINE_##op(a, b, c)                                                 \
+    UM32_MACHINE_DISPATCH();
+
+#define UM32_MACHINE_ORTHOGRAPHY_HANDLER(op, a)                                \
+specialized##op##_##a:                                                         \
+    reg_a[a] = curInstruction.value;                                           \
+    UM32_MACHINE_DISPATCH();
+
+    UM32_MACHINE_LOAD_STATE();
+    UM32_MACHINE_DISPATCH();
+
+operatorConditionalMove:
+    if (reg_a[curInstruction.regC] != 0)
+    {
+        reg_a[curInstruction.regA] = reg_a[curInstruction.regB];
+    }
+    UM32_MACHINE_DISPATCH();
+
+operatorArrayIndex:
+    if (!UM32_MACHINE_CHECKED(um32_array_table_isValidOffset(
+            &(machine_p->arrayTable), reg_a[curInstruction.regB],
+            reg_a[curInstruction.regC])))
+    {
+        machine_p->status = UM32_MACHINE_STATUS_FAULT;
+        goto finished;
+    }
+    reg_a[curInstruction.regA] = um32_platter_toUInt32(
+        um32_array_table_get(&(machine_p->arrayTable),
+                             reg_a[curInstruction.regB])->platters_p
+        [reg_a[curInstruction.regC]]);
+    UM32_MACHINE_DISPATCH();
+
+operatorArrayAmendment:
+    // Arrays that are shared or loaded as a program, including the 0 array,
+    // are amended by the handler so that copies and decoded programs are
+    // maintained
+    //
+    if (!UM32_MACHINE_CHECKED(um32_array_table_isValidOffset(
+            &(machine_p->arrayTable), reg_a[curInstruction.regA],
+            reg_a[curInstruction.regB])))
+    {
+        machine_p->status = UM32_MACHINE_STATUS_FAULT;
+        goto finished;
+    }
+    {
+        um32_array_pt array_p = um32_array_table_get(&(machine_p->arrayTable),
+                                                     reg_a[curInstruction.regA]);
+        if (um32_array_storage_isExclusive(
+                um32_array_storage_fromPlatters(array_p->platters_p)))
+        {
+            array_p->platters_p[reg_a[curInstruction.regB]] =
+                um32_platter_fromUInt32(reg_a[curInstruction.regC]);
+            UM32_MACHINE_DISPATCH();
+        }
+    }
+    UM32_MACHINE_SAVE_STATE();
+    um32_machine_handleOperatorArrayAmendment(machine_p, curInstruction);
+    UM32_MACHINE_LOAD_STATE();
+    UM32_MACHINE_DISPATCH();
+
+operatorAddition:
+    reg_a[curInstruction.regA] =
+        reg_a[curInstruction.regB] + reg_a[curInstruction.regC];
+    UM32_MACHINE_DISPATCH();
+
+operatorMultiplication:
+    reg_a[curInstruction.regA] =
+        reg_a[curInstruction.regB] * reg_a[curInstruction.regC];
+    UM32_MACHINE_DISPATCH();
+
+operatorDivision:
+    if (reg_a[curInstruction.regC] == 0)
+    {
+        machine_p->status = UM32_MACHINE_STATUS_FAULT;
+        goto finished;
+    }
+    reg_a[curInstruction.regA] =
+        reg_a[curInstruction.regB] / reg_a[curInstruction.regC];
+    UM32_MACHINE_DISPATCH();
+
+operatorNotAnd:
+    reg_a[curInstruction.regA] =
+        ~(reg_a[curInstruction.regB] & reg_a[curInstruction.regC]);
+    UM32_MACHINE_DISPATCH();
+
+operatorHalt:
+    um32_machine_handleOperatorHalt();
+    machine_p->status = UM32_MACHINE_STATUS_HALTED;
+    goto finished;
+
+operatorAllocation:
+#ifdef UM32_MACHINE_PROFILE_ENABLED
+    if (machine_p->profile_p != NULL)
+    {
+        um32_profile_countAllocation(machine_p->profile_p,
+                                     reg_a[curInstruction.regC]);
+    }
+#endif
+    {
+        uint32_t id = um32_array_table_allocate(&(machine_p->arrayTable),
+                                                reg_a[curInstruction.regC]);
+        if (id == 0)
+        {
+            printf("Unable to allocate array of platters.\n");
+            UM32_MACHINE_DISPATCH();
+        }
+        reg_a[curInstruction.regB] = id;
+    }
+    UM32_MACHINE_DISPATCH();
+
+operatorAbandonment:
+    if (!UM32_MACHINE_CHECKED((reg_a[curInstruction.regC] != 0) &&
+            um32_array_table_isActive(&(machine_p->arrayTable),
+                                      reg_a[curInstruction.regC])))
+    {
+        machine_p->status = UM32_MACHINE_STATUS_FAULT;
+        goto finished;
+    }
+    um32_array_table_abandon(&(machine_p->arrayTable),
+                             reg_a[curInstruction.regC]);
+    UM32_MACHINE_DISPATCH();
+
+operatorOutput:
+    UM32_MACHINE_SAVE_STATE();
+    um32_machine_handleOperatorOutput(machine_p, curInstruction);
+    if (machine_p->status != UM32_MACHINE_STATUS_RUNNING) { goto finished; }
+    UM32_MACHINE_DISPATCH();
+
+operatorInput:
+    UM32_MACHINE_SAVE_STATE();
+    um32_machine_handleOperatorInput(machine_p, curInstruction);
+    UM32_MACHINE_LOAD_STATE();
+    if (machine_p->status != UM32_MACHINE_STATUS_RUNNING) { goto finished; }
+    UM32_MACHINE_DISPATCH();
+
+operatorLoadProgram:
+    // Loading the 0 array is a plain jump and stays in the engine. Jumping past
+    // the end lands on the end sentinel.
+    //
+    if (reg_a[curInstruction.regB] == 0)
+    {
+#ifdef UM32_MACHINE_PROFILE_ENABLED
+        if (machine_p->profile_p != NULL)
+        {
+            um32_profile_countLoadProgram(machine_p->profile_p, 0);
+        }
+#endif
+        executionFinger_p = decoded_p + ((reg_a[curInstruction.regC] < length)
+                                         ? reg_a[curInstruction.regC]
+                                         : length);
+        UM32_MACHINE_DISPATCH();
+    }
+    UM32_MACHINE_SAVE_STATE();
+    um32_machine_handleOperatorLoadProgram(machine_p, curInstruction);
+    UM32_MACHINE_LOAD_STATE();
+    if (machine_p->status != UM32_MACHINE_STATUS_RUNNING) { goto finished; }
+    UM32_MACHINE_DISPATCH();
+
+operatorOrthography:
+    reg_a[curInstruction.regA] = curInstruction.value;
+    UM32_MACHINE_DISPATCH();
+
+operatorOrthographyPair:
+    reg_a[curInstruction.regA] = curInstruction.value;
+    UM32_MACHINE_FETCH_SECOND();
+    reg_a[curInstruction.regA] = curInstruction.value;
+    UM32_MACHINE_DISPATCH();
+
+operatorNotAndPair:
+    reg_a[curInstruction.regA] =
+        ~(reg_a[curInstruction.regB] & reg_a[curInstruction.regC]);
+    UM32_MACHINE_FETCH_SECOND();
+    reg_a[curInstruction.regA] =
+        ~(reg_a[curInstruction.regB] & reg_a[curInstruction.regC]);
+    UM32_MACHINE_DISPATCH();
+
+operatorOrthographyLoadProgram:
+    reg_a[curInstruction.regA] = curInstruction.value;
+    UM32_MACHINE_FETCH_SECOND();
+    goto operatorLoadProgram;
+
+operatorInvalid:
+    // Operators 14 and 15 are not defined and are skipped, as in the switch
+    // engine
+    //
+    UM32_MACHINE_DISPATCH();
+
+serviceRequests:
+    // A snapshot or sample was requested while the instruction at the finger
+    // was about to be dispatched, so the sample is counted against it and the
+    // snapshot resumes from it
+    //
+    UM32_MACHINE_SAVE_STATE();
+    um32_machine_serviceRequests(machine_p,
+                                 (uint32_t)(executionFinger_p - decoded_p));
+    UM32_MACHINE_DISPATCH();
+
+    // Specialized handlers, placed after the generic ones
+    //
+#ifdef UM32_INSTRUCTION_SPECIALIZED_HANDLERS
+    UM32_MACHINE_EACH_REGISTERS(UM32_MACHINE_SPECIALIZED_HANDLER,
+                                CONDITIONAL_MOVE)
+    UM32_MACHINE_EACH_REGISTERS(UM32_MACHINE_SPECIALIZED_HANDLER, ADDITION)
+    UM32_MACHINE_EACH_REGISTERS(UM32_MACHINE_SPECIALIZED_HANDLER,
+                                MULTIPLICATION)
+    UM32_MACHINE_EACH_REGISTERS(UM32_MACHINE_SPECIALIZED_HANDLER, DIVISION)
+    UM32_MACHINE_EACH_REGISTERS(UM32_MACHINE_SPECIALIZED_HANDLER, NOT_AND)
+    UM32_MACHINE_EACH_REGISTER(UM32_MACHINE_ORTHOGRAPHY_HANDLER, ORTHOGRAPHY)
+#endif
+
+operatorEnd:
+    // Running off the end of the 0 array fetched the end sentinel, which is
+    // not an instruction, and fails the machine
+    //
+#ifdef UM32_MACHINE_COUNT_INSTRUCTIONS
+    machine_p->stats.instructions--;
+#endif
+    executionFinger_p--;
+    machine_p->status = UM32_MACHINE_STATUS_FAULT;
+
+finished:
+    UM32_MACHINE_SAVE_STATE();
+
+#undef UM32_MACHINE_ORTHOGRAPHY_HANDLER
+#undef UM32_MACHINE_SPECIALIZED_HANDLER
+#undef UM32_MACHINE_NOT_AND
+#undef UM32_MACHINE_DIVISION
+#undef UM32_MACHINE_MULTIPLICATION
+#undef UM32_MACHINE_ADDITION
+#undef UM32_MACHINE_CONDITIONAL_MOVE
+#undef UM32_MACHINE_FETCH_SECOND
+#undef UM32_MACHINE_DISPATCH
+#undef UM32_MACHINE_COUNT_INSTRUCTION
+#undef UM32_MACHINE_PROFILE_INSTRUCTION
+#undef UM32_MACHINE_TRACE_INSTRUCTION
+#undef UM32_MACHINE_SAVE_STATE
+#undef UM32_MACHINE_LOAD_STATE
+}
+#endif
+
+// Runs the machine until it halts, fails or needs input that is not available
+// yet, and writes out any buffered output
+//
+um32_machine_status_t
+um32_machine_run(um32_machine_pt machine_p)
+{
+    if (!um32_machine_resume(machine_p))
+    {
+        return um32_machine_reportStatus(machine_p);
     }
+
+#if defined(UM32_MACHINE_ENGINE_THREADED)
+    um32_machine_runThreaded(machine_p);
+#elif defined(UM32_MACHINE_ENGINE_JIT)
+    um32_machine_runJit(machine_p);
+#else
+    um32_machine_runSwitch(machine_p);
+#endif
+
+    um32_machine_flushOutput(machine_p);
+    um32_machine_saveTrace(machine_p);
+
+    return um32_machine_reportStatus(machine_p);
 }
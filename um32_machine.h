@@ -1,11 +1,74 @@
 #ifndef UM32_MACHINE_H
 #define UM32_MACHINE_H
 
+#include "um32_array.h"
+#include "um32_instruction.h"
 #include "um32_platter.h"
+#include "um32_profile.h"
+#include "um32_sampler.h"
+#include "um32_trace.h"
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <sys/types.h>
 
 #define UM32_NUM_GENERAL_PURPOSE_REGISTERS 8
+#define UM32_MACHINE_OUTPUT_BUFFER_SIZE 65536
+#define UM32_MACHINE_INPUT_BUFFER_SIZE 65536
+
+// Policy for flushing console output. Line-buffered output is written at the
+// end of every line; fully buffered output only when the buffer fills up.
+// Either way output is flushed before Input waits for the console and when the
+// machine stops.
+//
+typedef enum
+{
+    UM32_MACHINE_OUTPUT_LINE_BUFFERED   = 0,
+    UM32_MACHINE_OUTPUT_FULLY_BUFFERED  = 1,
+} um32_machine_outputBuffering_t;
+
+// State of the machine when um32_machine_run or um32_machine_runFor returns.
+// A running machine has used up its instruction budget and can be run again,
+// as can one that needs input once more is available, or one that needs
+// output once the console can take more. A halted or failed machine stays
+// that way, once any output it still holds has been written.
+//
+typedef enum
+{
+    UM32_MACHINE_STATUS_RUNNING      = 0,
+    UM32_MACHINE_STATUS_HALTED       = 1,
+    UM32_MACHINE_STATUS_NEEDS_INPUT  = 2,
+    UM32_MACHINE_STATUS_FAULT        = 3,
+    UM32_MACHINE_STATUS_NEEDS_OUTPUT = 4,
+} um32_machine_status_t;
+
+// Console callbacks for hosts embedding the machine. The read callback fills
+// buf_p with up to size bytes and returns how many it read, 0 at the end of
+// input, UM32_MACHINE_IO_WOULD_BLOCK if no input is available yet or -1 on
+// error. The write callback writes up to size bytes and returns how many it
+// wrote, which must be at least one, UM32_MACHINE_IO_WOULD_BLOCK if it cannot
+// take anything yet or -1 on error.
+//
+#define UM32_MACHINE_IO_WOULD_BLOCK (-2)
+
+typedef ssize_t (*um32_machine_readCallback_t)(void* context_p,
+                                               unsigned char* buf_p,
+                                               size_t size);
+typedef ssize_t (*um32_machine_writeCallback_t)(void* context_p,
+                                                const char* buf_p,
+                                                size_t size);
+
+// Run counters. Instructions are only counted by builds that define
+// UM32_MACHINE_COUNT_INSTRUCTIONS, since counting slows down dispatch; the
+// console system calls are always counted.
+//
+typedef struct
+{
+    uint64_t  instructions;
+    uint64_t  readCalls;
+    uint64_t  writeCalls;
+} um32_machine_stats_t;
+typedef um32_machine_stats_t* um32_machine_stats_pt;
 
 // Structure representing a UM32 virtual machine.
 //
@@ -52,12 +115,60 @@ typedef struct
     um32_platter_pt  zeroArray_p;
     um32_platter_pt  zeroArrayEnd_p;
     um32_platter_pt  executionFinger_p;
+    um32_instruction_pt zeroArrayDecoded_p;
+    um32_array_table_t arrayTable;
+    um32_machine_outputBuffering_t outputBuffering;
+    int              outputFd;
+    size_t           outputBufferUsed;
+    char             outputBuffer_a[UM32_MACHINE_OUTPUT_BUFFER_SIZE];
+    int              inputFd;
+    const unsigned char* inputCur_p;
+    const unsigned char* inputEnd_p;
+    const unsigned char* inputMapped_p;
+    size_t           inputMappedSize;
+    unsigned char    inputBuffer_a[UM32_MACHINE_INPUT_BUFFER_SIZE];
+    um32_machine_stats_t stats;
+    um32_machine_status_t status;
+    um32_machine_readCallback_t readCallback;
+    um32_machine_writeCallback_t writeCallback;
+    void*            callbackContext_p;
+    um32_profile_pt  profile_p;
+    const char*      snapshotName;
+    um32_trace_pt    trace_p;
+    const char*      traceName;
+    um32_sampler_pt  sampler_p;
 } um32_machine_t;
 typedef um32_machine_t* um32_machine_pt;
 
 um32_machine_pt um32_machine_create(void);
 void um32_machine_free(um32_machine_pt machine_p);
 bool um32_machine_init(um32_machine_pt machine_p, FILE* file_p);
-void um32_machine_run(um32_machine_pt machine_p);
+um32_array_storage_pt um32_machine_createImage(FILE* file_p);
+bool um32_machine_initFromImage(um32_machine_pt machine_p,
+                                um32_array_storage_pt image_p);
+um32_machine_status_t um32_machine_run(um32_machine_pt machine_p);
+um32_machine_status_t um32_machine_runFor(um32_machine_pt machine_p,
+                                          uint64_t numInstructions);
+bool um32_machine_discharge(um32_machine_pt machine_p);
+bool um32_machine_flushOutput(um32_machine_pt machine_p);
+bool um32_machine_setInput(um32_machine_pt machine_p, int fd);
+bool um32_machine_setOutput(um32_machine_pt machine_p, int fd);
+void um32_machine_setCallbacks(um32_machine_pt machine_p,
+                               um32_machine_readCallback_t readCallback,
+                               um32_machine_writeCallback_t writeCallback,
+                               void* context_p);
+void um32_machine_setOutputBuffering(um32_machine_pt machine_p,
+                                     um32_machine_outputBuffering_t buffering);
+bool um32_machine_enableProfile(um32_machine_pt machine_p);
+void um32_machine_printProfile(um32_machine_pt machine_p, FILE* file_p);
+bool um32_machine_enableTrace(um32_machine_pt machine_p, const char* fileName,
+                              uint32_t numRecords);
+bool um32_machine_enableSampling(um32_machine_pt machine_p);
+bool um32_machine_saveSnapshot(um32_machine_pt machine_p, const char* name);
+bool um32_machine_restoreSnapshot(um32_machine_pt machine_p, const char* name);
+void um32_machine_setSnapshotFile(um32_machine_pt machine_p, const char* name);
+void um32_machine_requestSnapshot(void);
+void um32_machine_requestSample(void);
+bool um32_machine_hasRequests(void);
 
 #endif /* UM32_MACHINE_H */
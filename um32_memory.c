@@ -0,0 +1,190 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#include "um32_memory.h"
+
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Slabs are chained through their first bytes so they can all be released
+// together. The header is one granule so blocks stay aligned.
+//
+typedef struct um32_memory_slab_s
+{
+    struct um32_memory_slab_s* next_p;
+    char                       padding_a[UM32_MEMORY_POOL_GRANULE - sizeof(void*)];
+} um32_memory_slab_t;
+typedef um32_memory_slab_t* um32_memory_slab_pt;
+
+void
+um32_memory_pool_init(um32_memory_pool_pt pool_p)
+{
+    memset(pool_p, 0, sizeof(um32_memory_pool_t));
+}
+
+// Releases every slab. Blocks larger than the pool must have been deallocated
+// already.
+//
+void
+um32_memory_pool_free(um32_memory_pool_pt pool_p)
+{
+    um32_memory_slab_pt slab_p = (um32_memory_slab_pt)pool_p->slabs_p;
+    while (slab_p != NULL)
+    {
+        um32_memory_slab_pt next_p = slab_p->next_p;
+        um32_memory_free(slab_p);
+        slab_p = next_p;
+    }
+
+    memset(pool_p, 0, sizeof(um32_memory_pool_t));
+}
+
+// Returns size rounded up to whole pages
+//
+static size_t
+um32_memory_pageAlign(size_t size)
+{
+    size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    return (size + pageSize - 1) & ~(pageSize - 1);
+}
+
+// Maps a zeroed block of size bytes
+//
+static void*
+um32_memory_pool_map(um32_memory_pool_pt pool_p, size_t size)
+{
+    size_t mapSize = um32_memory_pageAlign(size);
+    void* block_p = mmap(NULL, mapSize, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (block_p == MAP_FAILED) { return NULL; }
+
+#ifdef MADV_HUGEPAGE
+    if (pool_p->hugePages && (mapSize >= UM32_MEMORY_HUGE_PAGE_SIZE))
+    {
+        madvise(block_p, mapSize, MADV_HUGEPAGE);
+    }
+#endif
+
+    pool_p->stats.mapAllocations++;
+    pool_p->stats.mappedBytes += mapSize;
+    if (pool_p->stats.mappedBytes > pool_p->stats.peakMappedBytes)
+    {
+        pool_p->stats.peakMappedBytes = pool_p->stats.mappedBytes;
+    }
+
+    return block_p;
+}
+
+// Slow path of um32_memory_pool_alloc: carves a new block out of the current
+// slab, or hands requests too large for the pool to the system allocator or,
+// for the largest, the kernel
+//
+void*
+um32_memory_pool_allocSlow(um32_memory_pool_pt pool_p, size_t size)
+{
+    if (um32_memory_pool_isMapped(size))
+    {
+        return um32_memory_pool_map(pool_p, size);
+    }
+
+    if (size > UM32_MEMORY_POOL_MAX_SIZE)
+    {
+        pool_p->stats.systemAllocations++;
+        return um32_memory_malloc(size);
+    }
+
+    size_t blockSize =
+        (um32_memory_pool_sizeClass(size) + 1) * UM32_MEMORY_POOL_GRANULE;
+
+    // Start a new slab when the current one is used up. Whatever is left of
+    // the old slab is too small for this class and is simply not used.
+    //
+    if ((size_t)(pool_p->slabEnd_p - pool_p->slabCur_p) < blockSize)
+    {
+        um32_memory_slab_pt slab_p =
+            (um32_memory_slab_pt)um32_memory_malloc(UM32_MEMORY_POOL_SLAB_SIZE);
+        if (slab_p == NULL) { return NULL; }
+
+        slab_p->next_p = (um32_memory_slab_pt)pool_p->slabs_p;
+        pool_p->slabs_p = slab_p;
+        pool_p->slabCur_p = (char*)(slab_p + 1);
+        pool_p->slabEnd_p = (char*)slab_p + UM32_MEMORY_POOL_SLAB_SIZE;
+        pool_p->stats.slabs++;
+    }
+
+    void* block_p = pool_p->slabCur_p;
+    pool_p->slabCur_p += blockSize;
+    pool_p->stats.poolAllocations++;
+
+    return block_p;
+}
+
+// Deallocates a block too large for the pool, unmapping it if it was mapped
+//
+void
+um32_memory_pool_deallocLarge(um32_memory_pool_pt pool_p, void* ptr,
+                              size_t size)
+{
+    if (um32_memory_pool_isMapped(size))
+    {
+        size_t mapSize = um32_memory_pageAlign(size);
+        munmap(ptr, mapSize);
+        pool_p->stats.mapDeallocations++;
+        pool_p->stats.mappedBytes -= mapSize;
+        return;
+    }
+
+    pool_p->stats.systemDeallocations++;
+    um32_memory_free(ptr);
+}
+
+// Returns how many bytes of the mapped block of size bytes at ptr are resident
+// in memory
+//
+uint64_t
+um32_memory_residentBytes(void* ptr, size_t size)
+{
+    size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    size_t numPages = um32_memory_pageAlign(size) / pageSize;
+
+    unsigned char* vec_p = (unsigned char*)um32_memory_malloc(numPages);
+    if (vec_p == NULL) { return 0; }
+
+    uint64_t resident = 0;
+    if (mincore(ptr, numPages * pageSize, vec_p) == 0)
+    {
+        for (size_t i=0; i<numPages; i++)
+        {
+            if (vec_p[i] & 1) { resident += pageSize; }
+        }
+    }
+
+    um32_memory_free(vec_p);
+    return resident;
+}
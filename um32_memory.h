@@ -29,31 +29,143 @@
 #ifndef UM32_MEMORY_H
 #define UM32_MEMORY_H
 
-#include <malloc.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 
-inline void*
+// Size-class pool for guest arrays. Guest programs allocate and abandon huge
+// numbers of tiny arrays, so requests up to UM32_MEMORY_POOL_MAX_SIZE bytes are
+// rounded up to a multiple of UM32_MEMORY_POOL_GRANULE and served from a free
+// list per size class, carving new blocks out of large slabs when the list is
+// empty. Larger requests go straight to the system allocator. The caller
+// passes the size back when deallocating, so blocks carry no header.
+//
+#define UM32_MEMORY_POOL_GRANULE     16
+#define UM32_MEMORY_POOL_MAX_SIZE    1024
+#define UM32_MEMORY_POOL_NUM_CLASSES \
+    (UM32_MEMORY_POOL_MAX_SIZE / UM32_MEMORY_POOL_GRANULE)
+#define UM32_MEMORY_POOL_SLAB_SIZE   (256 * 1024)
+
+// Requests of at least UM32_MEMORY_MAP_THRESHOLD bytes are mapped straight
+// from the kernel instead. Their pages are zero until first touched, so large
+// arrays cost nothing up front, and they go back to the kernel as soon as they
+// are deallocated. With hugePages set, mappings of at least
+// UM32_MEMORY_HUGE_PAGE_SIZE bytes are offered transparent huge pages.
+//
+#define UM32_MEMORY_MAP_THRESHOLD    (1024 * 1024)
+#define UM32_MEMORY_HUGE_PAGE_SIZE   (2 * 1024 * 1024)
+
+// Allocation counters. The pool hit rate is poolReuses / poolAllocations.
+// Mapped bytes are counted in whole pages.
+//
+typedef struct
+{
+    uint64_t  poolAllocations;
+    uint64_t  poolReuses;
+    uint64_t  poolDeallocations;
+    uint64_t  systemAllocations;
+    uint64_t  systemDeallocations;
+    uint64_t  slabs;
+    uint64_t  mapAllocations;
+    uint64_t  mapDeallocations;
+    uint64_t  mappedBytes;
+    uint64_t  peakMappedBytes;
+} um32_memory_stats_t;
+typedef um32_memory_stats_t* um32_memory_stats_pt;
+
+typedef struct
+{
+    void*                freeLists_a[UM32_MEMORY_POOL_NUM_CLASSES];
+    char*                slabCur_p;
+    char*                slabEnd_p;
+    void*                slabs_p;
+    bool                 hugePages;
+    um32_memory_stats_t  stats;
+} um32_memory_pool_t;
+typedef um32_memory_pool_t* um32_memory_pool_pt;
+
+void um32_memory_pool_init(um32_memory_pool_pt pool_p);
+void um32_memory_pool_free(um32_memory_pool_pt pool_p);
+void* um32_memory_pool_allocSlow(um32_memory_pool_pt pool_p, size_t size);
+void um32_memory_pool_deallocLarge(um32_memory_pool_pt pool_p, void* ptr,
+                                   size_t size);
+uint64_t um32_memory_residentBytes(void* ptr, size_t size);
+
+static inline void*
 um32_memory_malloc(size_t size)
 {
     return malloc(size);
 }
 
-inline void
+static inline void
 um32_memory_free(void* ptr)
 {
     free(ptr);
 }
 
-inline void*
+static inline void*
 um32_memory_realloc(void* ptr, size_t size)
 {
     return realloc(ptr, size);
 }
 
-inline size_t
-um32_memory_malloc_usable_size(void* ptr)
+// Returns true if blocks of size bytes are mapped from the kernel, and so are
+// already zero when allocated
+//
+static inline bool
+um32_memory_pool_isMapped(size_t size)
 {
-    return malloc_usable_size(ptr);
+    return size >= UM32_MEMORY_MAP_THRESHOLD;
+}
+
+// Returns the size class serving size bytes
+//
+static inline size_t
+um32_memory_pool_sizeClass(size_t size)
+{
+    return (size + UM32_MEMORY_POOL_GRANULE - 1) / UM32_MEMORY_POOL_GRANULE - 1;
+}
+
+// Allocates size bytes, which must be non-zero, reusing a deallocated block of
+// the same size class if there is one
+//
+static inline void*
+um32_memory_pool_alloc(um32_memory_pool_pt pool_p, size_t size)
+{
+    if (size <= UM32_MEMORY_POOL_MAX_SIZE)
+    {
+        void** freeList_pp =
+            &(pool_p->freeLists_a[um32_memory_pool_sizeClass(size)]);
+        void* block_p = *freeList_pp;
+        if (block_p != NULL)
+        {
+            *freeList_pp = *(void**)block_p;
+            pool_p->stats.poolAllocations++;
+            pool_p->stats.poolReuses++;
+            return block_p;
+        }
+    }
+
+    return um32_memory_pool_allocSlow(pool_p, size);
+}
+
+// Deallocates a block returned by um32_memory_pool_alloc for the same size
+//
+static inline void
+um32_memory_pool_dealloc(um32_memory_pool_pt pool_p, void* ptr, size_t size)
+{
+    if (size > UM32_MEMORY_POOL_MAX_SIZE)
+    {
+        um32_memory_pool_deallocLarge(pool_p, ptr, size);
+        return;
+    }
+
+    void** freeList_pp =
+        &(pool_p->freeLists_a[um32_memory_pool_sizeClass(size)]);
+    *(void**)ptr = *freeList_pp;
+    *freeList_pp = ptr;
+    pool_p->stats.poolDeallocations++;
 }
 
 #endif /* UM32_MEMORY_H */
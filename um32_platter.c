@@ -30,6 +30,17 @@
 
 #include <arpa/inet.h>
 #include <stdio.h>
+#include <string.h>
+
+// Bulk byte swapping uses SSSE3 or AVX2 shuffles when the host supports them.
+// The kernels are compiled for their instruction set regardless of the flags
+// the rest of the program is built with and selected at run time.
+//
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && \
+    (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define UM32_PLATTER_SIMD_ENABLED
+#include <immintrin.h>
+#endif
 
 inline um32_platter_t
 um32_platter_toHostByteOrder(um32_platter_t platter)
@@ -43,6 +54,76 @@ um32_platter_toNetworkByteOrder(um32_platter_t platter)
     return um32_platter_fromUInt32(htonl(um32_platter_toUInt32(platter)));
 }
 
+// Converts count big-endian platters read from src_p into host byte order,
+// storing them in platters_p. The source does not need to be aligned.
+//
+#ifdef UM32_PLATTER_SIMD_ENABLED
+__attribute__((target("avx2"))) static size_t
+um32_platter_toHostByteOrderAvx2(uint32_t* dst_p, const char* src_p,
+                                 size_t count)
+{
+    const __m256i shuffle = _mm256_setr_epi8(
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i val = _mm256_loadu_si256((const __m256i*)(src_p + i * 4));
+        _mm256_storeu_si256((__m256i*)(dst_p + i),
+                            _mm256_shuffle_epi8(val, shuffle));
+    }
+
+    return i;
+}
+
+__attribute__((target("ssse3"))) static size_t
+um32_platter_toHostByteOrderSsse3(uint32_t* dst_p, const char* src_p,
+                                  size_t count)
+{
+    const __m128i shuffle = _mm_setr_epi8(
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i val = _mm_loadu_si128((const __m128i*)(src_p + i * 4));
+        _mm_storeu_si128((__m128i*)(dst_p + i), _mm_shuffle_epi8(val, shuffle));
+    }
+
+    return i;
+}
+#endif
+
+void
+um32_platter_toHostByteOrderArray(um32_platter_pt platters_p,
+                                  const void* src_p, size_t count)
+{
+    uint32_t* dst_p = (uint32_t*)(void*)platters_p;
+    const char* bytes_p = (const char*)src_p;
+    size_t i = 0;
+
+#ifdef UM32_PLATTER_SIMD_ENABLED
+    if (__builtin_cpu_supports("avx2"))
+    {
+        i = um32_platter_toHostByteOrderAvx2(dst_p, bytes_p, count);
+    }
+    else if (__builtin_cpu_supports("ssse3"))
+    {
+        i = um32_platter_toHostByteOrderSsse3(dst_p, bytes_p, count);
+    }
+#endif
+
+    // Scalar fallback, which also handles whatever the vector kernels leave
+    //
+    for (; i<count; i++)
+    {
+        uint32_t val;
+        memcpy(&val, bytes_p + i * 4, sizeof(val));
+        dst_p[i] = ntohl(val);
+    }
+}
+
 // Converts um32_platter_t to uint32_t, taking endianness in consideration
 //
 inline uint32_t
@@ -81,9 +162,24 @@ um32_platter_toString(um32_platter_t platter, char* buf_p)
         "ORTHOGRAPHY",
     };
 
-    sprintf(buf_p, "{ operator = %s, regA = %u, regB = %u, regC = %u }",
-            um32_operator_stringTable_a[platter.operatorNum],
-            platter.regA, platter.regB, platter.regC);
+    if (platter.operatorNum >= UM32_OPERATOR_MAX)
+    {
+        sprintf(buf_p, "{ operator = INVALID_%u }", platter.operatorNum);
+    }
+    else if (platter.operatorNum == UM32_OPERATOR_ORTHOGRAPHY)
+    {
+        um32_platter_special_t special =
+            um32_platter_special_fromPlatter(platter);
+        sprintf(buf_p, "{ operator = %s, regA = %u, value = %u }",
+                um32_operator_stringTable_a[platter.operatorNum],
+                special.regA, special.value);
+    }
+    else
+    {
+        sprintf(buf_p, "{ operator = %s, regA = %u, regB = %u, regC = %u }",
+                um32_operator_stringTable_a[platter.operatorNum],
+                platter.regA, platter.regB, platter.regC);
+    }
 }
 
 // Convert um32_platter_t to um32_platter_special_t
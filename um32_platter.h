@@ -30,6 +30,7 @@
 #define UM32_PLATTER_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 // Enumeration for all operators support by the virtual machine
@@ -153,6 +154,8 @@ typedef struct
 typedef um32_platter_special_t* um32_platter_special_pt;
 
 um32_platter_t um32_platter_toHostByteOrder(um32_platter_t platter);
+void um32_platter_toHostByteOrderArray(um32_platter_pt platters_p,
+                                       const void* src_p, size_t count);
 uint32_t um32_platter_toUInt32(um32_platter_t platter);
 um32_platter_t um32_platter_fromUInt32(uint32_t val);
 void um32_platter_toString(um32_platter_t platter, char* buf_p);
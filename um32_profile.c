@@ -0,0 +1,221 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#include "um32_profile.h"
+
+#include "um32_memory.h"
+#include "um32_platter.h"
+#include <inttypes.h>
+#include <string.h>
+
+static const char* const um32_profile_operatorNames_a[UM32_OPERATOR_MAX] =
+{
+    "Conditional Move",
+    "Array Index",
+    "Array Amendment",
+    "Addition",
+    "Multiplication",
+    "Division",
+    "Not-And",
+    "Halt",
+    "Allocation",
+    "Abandonment",
+    "Output",
+    "Input",
+    "Load Program",
+    "Orthography",
+};
+
+static const char* const um32_profile_superinstructionNames_a[
+    UM32_INSTRUCTION_NUM_OPERATORS - UM32_INSTRUCTION_OPERATOR_END - 1] =
+{
+    "Orthography Pair",
+    "Not-And Pair",
+    "Orthography Load Program",
+};
+
+static const char*
+um32_profile_operatorName(uint8_t operatorNum)
+{
+    operatorNum = um32_instruction_baseOperator(operatorNum);
+
+    return (operatorNum < UM32_OPERATOR_MAX)
+        ? um32_profile_operatorNames_a[operatorNum]
+        : "Invalid";
+}
+
+um32_profile_pt
+um32_profile_create(void)
+{
+    um32_profile_pt profile_p =
+        (um32_profile_pt)um32_memory_malloc(sizeof(um32_profile_t));
+    if (profile_p == NULL) { return NULL; }
+
+    memset(profile_p, 0, sizeof(um32_profile_t));
+
+    return profile_p;
+}
+
+void
+um32_profile_free(um32_profile_pt profile_p)
+{
+    if (profile_p == NULL) { return; }
+
+    um32_memory_free(profile_p->offsets_p);
+    um32_memory_free(profile_p);
+}
+
+// Makes room to count every offset of a 0 array of the given length, plus its
+// end sentinel. Counters of existing offsets are kept.
+//
+bool
+um32_profile_resize(um32_profile_pt profile_p, uint32_t length)
+{
+    uint64_t numOffsets = (uint64_t)length + 1;
+    if (numOffsets <= profile_p->numOffsets) { return true; }
+    if (numOffsets > SIZE_MAX / sizeof(uint64_t)) { return false; }
+
+    uint64_t* offsets_p = (uint64_t*)um32_memory_realloc(
+        profile_p->offsets_p, (size_t)numOffsets * sizeof(uint64_t));
+    if (offsets_p == NULL) { return false; }
+
+    memset(offsets_p + profile_p->numOffsets, 0,
+           (size_t)(numOffsets - profile_p->numOffsets) * sizeof(uint64_t));
+    profile_p->offsets_p = offsets_p;
+    profile_p->numOffsets = (uint32_t)numOffsets;
+
+    return true;
+}
+
+void
+um32_profile_countAllocation(um32_profile_pt profile_p, uint32_t length)
+{
+    uint32_t bucket = 0;
+    while (length != 0)
+    {
+        bucket++;
+        length >>= 1;
+    }
+
+    profile_p->allocations_a[bucket]++;
+}
+
+// Prints the report. Hot offsets are labelled with the operator found at that
+// offset in program_p, the 0 array at the time of printing.
+//
+void
+um32_profile_print(const um32_profile_t* profile_p, FILE* file_p,
+                   const um32_instruction_t* program_p, uint32_t programLength)
+{
+    uint64_t operators_a[UM32_INSTRUCTION_OPERATOR_END];
+    memcpy(operators_a, profile_p->operators_a, sizeof(operators_a));
+    for (int i=UM32_INSTRUCTION_OPERATOR_END+1;
+         i<UM32_INSTRUCTION_NUM_OPERATORS; i++)
+    {
+        operators_a[um32_instruction_baseOperator((uint8_t)i)] +=
+            profile_p->operators_a[i];
+    }
+
+    uint64_t numInstructions = 0;
+    for (int i=0; i<UM32_INSTRUCTION_OPERATOR_END; i++)
+    {
+        numInstructions += operators_a[i];
+    }
+    double total = (numInstructions == 0) ? 1.0 : (double)numInstructions;
+
+    fprintf(file_p, "Instructions:         %" PRIu64 "\n", numInstructions);
+    for (int i=0; i<UM32_INSTRUCTION_OPERATOR_END; i++)
+    {
+        if (operators_a[i] == 0) { continue; }
+        fprintf(file_p, "  %-18s  %14" PRIu64 "  %5.1f%%\n",
+                um32_profile_operatorName((uint8_t)i), operators_a[i],
+                100.0 * (double)operators_a[i] / total);
+    }
+
+    // Each superinstruction discharged two instructions with one dispatch
+    //
+    fprintf(file_p, "Superinstructions:\n");
+    for (int i=UM32_INSTRUCTION_OPERATOR_END+1;
+         i<UM32_INSTRUCTION_NUM_OPERATORS; i++)
+    {
+        fprintf(file_p, "  %-24s %9" PRIu64 "  %5.1f%%\n",
+                um32_profile_superinstructionNames_a[
+                    i - UM32_INSTRUCTION_OPERATOR_END - 1],
+                profile_p->operators_a[i],
+                200.0 * (double)profile_p->operators_a[i] / total);
+    }
+
+    fprintf(file_p, "Allocation sizes:\n");
+    for (int i=0; i<UM32_PROFILE_NUM_ALLOCATION_BUCKETS; i++)
+    {
+        if (profile_p->allocations_a[i] == 0) { continue; }
+
+        uint64_t low = (i == 0) ? 0 : ((uint64_t)1 << (i - 1));
+        uint64_t high = (i == 0) ? 0 : (((uint64_t)1 << i) - 1);
+        fprintf(file_p, "  %10" PRIu64 " - %-10" PRIu64 "  %14" PRIu64 "\n",
+                low, high, profile_p->allocations_a[i]);
+    }
+
+    fprintf(file_p, "Load Program:         %" PRIu64 " from array 0, %" PRIu64
+            " from other arrays\n", profile_p->loadProgramZero,
+            profile_p->loadProgramOther);
+
+    // Select the hottest offsets by insertion into a short sorted list
+    //
+    uint32_t hot_a[UM32_PROFILE_NUM_HOT_OFFSETS];
+    int numHot = 0;
+    for (uint32_t offset=0; offset<profile_p->numOffsets; offset++)
+    {
+        uint64_t count = profile_p->offsets_p[offset];
+        if (count == 0) { continue; }
+        if ((numHot == UM32_PROFILE_NUM_HOT_OFFSETS) &&
+            (count <= profile_p->offsets_p[hot_a[numHot - 1]]))
+        {
+            continue;
+        }
+
+        int i = (numHot < UM32_PROFILE_NUM_HOT_OFFSETS) ? numHot++ : (numHot - 1);
+        while ((i > 0) && (profile_p->offsets_p[hot_a[i - 1]] < count))
+        {
+            hot_a[i] = hot_a[i - 1];
+            i--;
+        }
+        hot_a[i] = offset;
+    }
+
+    fprintf(file_p, "Hottest offsets:\n");
+    for (int i=0; i<numHot; i++)
+    {
+        const char* name = (hot_a[i] < programLength)
+            ? um32_profile_operatorName(program_p[hot_a[i]].operatorNum)
+            : "End";
+        fprintf(file_p, "  %10" PRIu32 "  %-18s  %14" PRIu64 "  %5.1f%%\n",
+                hot_a[i], name, profile_p->offsets_p[hot_a[i]],
+                100.0 * (double)profile_p->offsets_p[hot_a[i]] / total);
+    }
+}
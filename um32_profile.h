@@ -0,0 +1,93 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#ifndef UM32_PROFILE_H
+#define UM32_PROFILE_H
+
+#include "um32_instruction.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Number of allocation size buckets. Bucket n counts allocations of 2^(n-1) to
+// 2^n - 1 platters, with bucket 0 counting empty arrays.
+//
+#define UM32_PROFILE_NUM_ALLOCATION_BUCKETS 33
+
+// Number of execution finger offsets listed in the report
+//
+#define UM32_PROFILE_NUM_HOT_OFFSETS 16
+
+// Execution profile of a machine. Instructions are counted per operator and
+// per offset into the '0' array; the end sentinel of a decoded program is
+// counted in a slot of its own so that the counters never need a branch.
+// Instructions that started a superinstruction are counted under it, and the
+// report adds them back to their base operator. Offsets keep their counts when
+// a new program is loaded.
+//
+typedef struct
+{
+    uint64_t   operators_a[UM32_INSTRUCTION_NUM_OPERATORS];
+    uint64_t   allocations_a[UM32_PROFILE_NUM_ALLOCATION_BUCKETS];
+    uint64_t   loadProgramZero;
+    uint64_t   loadProgramOther;
+    uint64_t*  offsets_p;
+    uint32_t   numOffsets;
+} um32_profile_t;
+typedef um32_profile_t* um32_profile_pt;
+
+um32_profile_pt um32_profile_create(void);
+void um32_profile_free(um32_profile_pt profile_p);
+bool um32_profile_resize(um32_profile_pt profile_p, uint32_t length);
+void um32_profile_countAllocation(um32_profile_pt profile_p, uint32_t length);
+void um32_profile_print(const um32_profile_t* profile_p, FILE* file_p,
+                        const um32_instruction_t* program_p,
+                        uint32_t programLength);
+
+// Counts one instruction at offset into the 0 array, which must be less than
+// the length the profile was last resized to
+//
+static inline void
+um32_profile_countInstruction(um32_profile_pt profile_p, uint8_t operatorNum,
+                              uint32_t offset)
+{
+    profile_p->operators_a[operatorNum]++;
+    profile_p->offsets_p[offset]++;
+}
+
+// Counts a Load Program, separating jumps within the 0 array from loads of
+// other arrays
+//
+static inline void
+um32_profile_countLoadProgram(um32_profile_pt profile_p, uint32_t id)
+{
+    if (id == 0) { profile_p->loadProgramZero++; }
+    else { profile_p->loadProgramOther++; }
+}
+
+#endif /* UM32_PROFILE_H */
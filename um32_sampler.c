@@ -0,0 +1,349 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#include "um32_sampler.h"
+
+#include "um32_memory.h"
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Initial number of hash table slots, a power of two. The table doubles once
+// it is half full.
+//
+#define UM32_SAMPLER_INITIAL_ENTRIES 1024
+
+static uint32_t
+um32_sampler_hash(uint32_t generation, uint32_t offset)
+{
+    uint32_t hash = (offset * 0x9E3779B1u) ^ (generation * 0x85EBCA77u);
+    return hash ^ (hash >> 16);
+}
+
+// Returns the slot holding the given generation and offset, or the empty slot
+// where it belongs
+//
+static um32_sampler_entry_pt
+um32_sampler_find(um32_sampler_entry_pt entries_p, uint32_t mask,
+                  uint32_t generation, uint32_t offset)
+{
+    uint32_t slot = um32_sampler_hash(generation, offset) & mask;
+    while ((entries_p[slot].count != 0) &&
+           ((entries_p[slot].generation != generation) ||
+            (entries_p[slot].offset != offset)))
+    {
+        slot = (slot + 1) & mask;
+    }
+
+    return &(entries_p[slot]);
+}
+
+// Doubles the hash table, moving every entry to its new slot
+//
+static bool
+um32_sampler_grow(um32_sampler_pt sampler_p)
+{
+    uint32_t numSlots = (sampler_p->mask + 1) * 2;
+    um32_sampler_entry_pt entries_p = (um32_sampler_entry_pt)um32_memory_malloc(
+        (size_t)numSlots * sizeof(um32_sampler_entry_t));
+    if (entries_p == NULL) { return false; }
+
+    memset(entries_p, 0, (size_t)numSlots * sizeof(um32_sampler_entry_t));
+    for (uint32_t i=0; i<=sampler_p->mask; i++)
+    {
+        um32_sampler_entry_pt entry_p = &(sampler_p->entries_p[i]);
+        if (entry_p->count == 0) { continue; }
+
+        *um32_sampler_find(entries_p, numSlots - 1, entry_p->generation,
+                           entry_p->offset) = *entry_p;
+    }
+
+    um32_memory_free(sampler_p->entries_p);
+    sampler_p->entries_p = entries_p;
+    sampler_p->mask = numSlots - 1;
+
+    return true;
+}
+
+// Creates a sampler for a machine whose '0' array holds length platters
+//
+um32_sampler_pt
+um32_sampler_create(uint32_t length)
+{
+    um32_sampler_pt sampler_p =
+        (um32_sampler_pt)um32_memory_malloc(sizeof(um32_sampler_t));
+    if (sampler_p == NULL) { return NULL; }
+
+    memset(sampler_p, 0, sizeof(um32_sampler_t));
+    sampler_p->entries_p = (um32_sampler_entry_pt)um32_memory_malloc(
+        UM32_SAMPLER_INITIAL_ENTRIES * sizeof(um32_sampler_entry_t));
+    if ((sampler_p->entries_p == NULL) ||
+        !um32_sampler_beginGeneration(sampler_p, 0, length))
+    {
+        um32_sampler_free(sampler_p);
+        return NULL;
+    }
+
+    memset(sampler_p->entries_p, 0,
+           UM32_SAMPLER_INITIAL_ENTRIES * sizeof(um32_sampler_entry_t));
+    sampler_p->mask = UM32_SAMPLER_INITIAL_ENTRIES - 1;
+
+    return sampler_p;
+}
+
+void
+um32_sampler_free(um32_sampler_pt sampler_p)
+{
+    if (sampler_p == NULL) { return; }
+
+    um32_memory_free(sampler_p->entries_p);
+    um32_memory_free(sampler_p->generations_p);
+    um32_memory_free(sampler_p);
+}
+
+// Notes that the array identified by arrayId, of length platters, has been
+// loaded as the program. Later samples are counted against it.
+//
+bool
+um32_sampler_beginGeneration(um32_sampler_pt sampler_p, uint32_t arrayId,
+                             uint32_t length)
+{
+    if (sampler_p->numGenerations == sampler_p->generationCapacity)
+    {
+        uint32_t capacity = (sampler_p->generationCapacity == 0)
+            ? 16
+            : (sampler_p->generationCapacity * 2);
+        um32_sampler_generation_pt generations_p =
+            (um32_sampler_generation_pt)um32_memory_realloc(
+                sampler_p->generations_p,
+                (size_t)capacity * sizeof(um32_sampler_generation_t));
+        if (generations_p == NULL) { return false; }
+
+        sampler_p->generations_p = generations_p;
+        sampler_p->generationCapacity = capacity;
+    }
+
+    um32_sampler_generation_pt generation_p =
+        &(sampler_p->generations_p[sampler_p->numGenerations++]);
+    generation_p->arrayId = arrayId;
+    generation_p->length = length;
+    generation_p->numSamples = 0;
+
+    return true;
+}
+
+// Counts one sample at offset into the current program
+//
+bool
+um32_sampler_record(um32_sampler_pt sampler_p, uint32_t offset)
+{
+    if ((sampler_p->numEntries + 1) * 2 > sampler_p->mask + 1)
+    {
+        if (!um32_sampler_grow(sampler_p)) { return false; }
+    }
+
+    uint32_t generation = sampler_p->numGenerations - 1;
+    um32_sampler_entry_pt entry_p = um32_sampler_find(
+        sampler_p->entries_p, sampler_p->mask, generation, offset);
+    if (entry_p->count == 0)
+    {
+        entry_p->generation = generation;
+        entry_p->offset = offset;
+        sampler_p->numEntries++;
+    }
+
+    entry_p->count++;
+    sampler_p->generations_p[generation].numSamples++;
+    sampler_p->numSamples++;
+
+    return true;
+}
+
+static int
+um32_sampler_compareOffsets(const void* a_p, const void* b_p)
+{
+    const um32_sampler_entry_t* a = (const um32_sampler_entry_t*)a_p;
+    const um32_sampler_entry_t* b = (const um32_sampler_entry_t*)b_p;
+
+    if (a->generation != b->generation)
+    {
+        return (a->generation < b->generation) ? -1 : 1;
+    }
+    if (a->offset != b->offset) { return (a->offset < b->offset) ? -1 : 1; }
+    return 0;
+}
+
+static int
+um32_sampler_compareCounts(const void* a_p, const void* b_p)
+{
+    const um32_sampler_entry_t* a = (const um32_sampler_entry_t*)a_p;
+    const um32_sampler_entry_t* b = (const um32_sampler_entry_t*)b_p;
+
+    if (a->count != b->count) { return (a->count > b->count) ? -1 : 1; }
+    return um32_sampler_compareOffsets(a_p, b_p);
+}
+
+// Returns a copy of the used entries ordered by generation and offset, or NULL
+// if there is not enough memory
+//
+static um32_sampler_entry_pt
+um32_sampler_sortEntries(const um32_sampler_t* sampler_p)
+{
+    um32_sampler_entry_pt sorted_p = (um32_sampler_entry_pt)um32_memory_malloc(
+        ((size_t)sampler_p->numEntries + 1) * sizeof(um32_sampler_entry_t));
+    if (sorted_p == NULL) { return NULL; }
+
+    uint32_t numSorted = 0;
+    for (uint32_t i=0; i<=sampler_p->mask; i++)
+    {
+        if (sampler_p->entries_p[i].count == 0) { continue; }
+        sorted_p[numSorted++] = sampler_p->entries_p[i];
+    }
+    qsort(sorted_p, numSorted, sizeof(um32_sampler_entry_t),
+          um32_sampler_compareOffsets);
+
+    return sorted_p;
+}
+
+// Prints the samples per program generation and the hottest address ranges
+//
+void
+um32_sampler_print(const um32_sampler_t* sampler_p, FILE* file_p)
+{
+    double total = (sampler_p->numSamples == 0)
+        ? 1.0
+        : (double)sampler_p->numSamples;
+
+    fprintf(file_p, "Samples:              %" PRIu64 "\n", sampler_p->numSamples);
+    // Select the most sampled generations by insertion into a short sorted
+    // list
+    //
+    uint32_t hot_a[UM32_SAMPLER_NUM_HOT_PROGRAMS];
+    int numHot = 0;
+    for (uint32_t i=0; i<sampler_p->numGenerations; i++)
+    {
+        uint64_t count = sampler_p->generations_p[i].numSamples;
+        if (count == 0) { continue; }
+        if ((numHot == UM32_SAMPLER_NUM_HOT_PROGRAMS) &&
+            (count <= sampler_p->generations_p[hot_a[numHot - 1]].numSamples))
+        {
+            continue;
+        }
+
+        int j = (numHot < UM32_SAMPLER_NUM_HOT_PROGRAMS) ? numHot++ : (numHot - 1);
+        while ((j > 0) &&
+               (sampler_p->generations_p[hot_a[j - 1]].numSamples < count))
+        {
+            hot_a[j] = hot_a[j - 1];
+            j--;
+        }
+        hot_a[j] = i;
+    }
+
+    fprintf(file_p, "Programs:             %" PRIu32 " loaded\n",
+            sampler_p->numGenerations);
+    for (int i=0; i<numHot; i++)
+    {
+        const um32_sampler_generation_t* generation_p =
+            &(sampler_p->generations_p[hot_a[i]]);
+        fprintf(file_p, "  generation %-6" PRIu32 " array %-10" PRIu32
+                " %10" PRIu32 " platters  %14" PRIu64 "  %5.1f%%\n", hot_a[i],
+                generation_p->arrayId, generation_p->length,
+                generation_p->numSamples,
+                100.0 * (double)generation_p->numSamples / total);
+    }
+
+    // Merge the offsets of each range, then order the ranges by samples
+    //
+    um32_sampler_entry_pt ranges_p = um32_sampler_sortEntries(sampler_p);
+    if (ranges_p == NULL) { return; }
+
+    uint32_t numRanges = 0;
+    for (uint32_t i=0; i<sampler_p->numEntries; i++)
+    {
+        uint32_t start = ranges_p[i].offset -
+            (ranges_p[i].offset % UM32_SAMPLER_RANGE_SIZE);
+        if ((numRanges > 0) &&
+            (ranges_p[numRanges - 1].generation == ranges_p[i].generation) &&
+            (ranges_p[numRanges - 1].offset == start))
+        {
+            ranges_p[numRanges - 1].count += ranges_p[i].count;
+            continue;
+        }
+
+        ranges_p[numRanges] = ranges_p[i];
+        ranges_p[numRanges].offset = start;
+        numRanges++;
+    }
+    qsort(ranges_p, numRanges, sizeof(um32_sampler_entry_t),
+          um32_sampler_compareCounts);
+
+    fprintf(file_p, "Hottest ranges:\n");
+    for (uint32_t i=0; (i<numRanges) && (i<UM32_SAMPLER_NUM_HOT_RANGES); i++)
+    {
+        fprintf(file_p, "  generation %-6" PRIu32 " %10" PRIu32 " - %-10" PRIu32
+                "  %14" PRIu64 "  %5.1f%%\n", ranges_p[i].generation,
+                ranges_p[i].offset,
+                ranges_p[i].offset + UM32_SAMPLER_RANGE_SIZE - 1,
+                ranges_p[i].count, 100.0 * (double)ranges_p[i].count / total);
+    }
+
+    um32_memory_free(ranges_p);
+}
+
+// Writes the samples in the folded stack format read by flame graph tools, one
+// line per offset: the program generation and array, the address range and the
+// offset, followed by the number of samples
+//
+bool
+um32_sampler_save(const um32_sampler_t* sampler_p, const char* fileName)
+{
+    um32_sampler_entry_pt sorted_p = um32_sampler_sortEntries(sampler_p);
+    if (sorted_p == NULL) { return false; }
+
+    FILE* file_p = fopen(fileName, "w");
+    if (file_p == NULL)
+    {
+        um32_memory_free(sorted_p);
+        return false;
+    }
+
+    for (uint32_t i=0; i<sampler_p->numEntries; i++)
+    {
+        uint32_t start = sorted_p[i].offset -
+            (sorted_p[i].offset % UM32_SAMPLER_RANGE_SIZE);
+        fprintf(file_p, "generation%" PRIu32 ":array%" PRIu32 ";%" PRIu32 "-%"
+                PRIu32 ";%" PRIu32 " %" PRIu64 "\n", sorted_p[i].generation,
+                sampler_p->generations_p[sorted_p[i].generation].arrayId,
+                start, start + UM32_SAMPLER_RANGE_SIZE - 1, sorted_p[i].offset,
+                sorted_p[i].count);
+    }
+
+    um32_memory_free(sorted_p);
+    return (fclose(file_p) == 0);
+}
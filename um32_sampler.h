@@ -0,0 +1,94 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#ifndef UM32_SAMPLER_H
+#define UM32_SAMPLER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Interval between samples, in microseconds of CPU time, used by default
+//
+#define UM32_SAMPLER_DEFAULT_INTERVAL 1000
+
+// Number of platters in each address range of the report
+//
+#define UM32_SAMPLER_RANGE_SIZE 64
+
+// Number of program generations and of address ranges listed in the report
+//
+#define UM32_SAMPLER_NUM_HOT_PROGRAMS 16
+#define UM32_SAMPLER_NUM_HOT_RANGES 16
+
+// Number of samples taken at one offset of one program generation
+//
+typedef struct
+{
+    uint32_t  generation;
+    uint32_t  offset;
+    uint64_t  count;
+} um32_sampler_entry_t;
+typedef um32_sampler_entry_t* um32_sampler_entry_pt;
+
+// A program loaded into the '0' array. Generation 0 is the program the machine
+// started with, and every Load Program from another array starts a new one.
+//
+typedef struct
+{
+    uint32_t  arrayId;
+    uint32_t  length;
+    uint64_t  numSamples;
+} um32_sampler_generation_t;
+typedef um32_sampler_generation_t* um32_sampler_generation_pt;
+
+// Sampling profile of a machine. Samples are counted per generation and offset
+// in an open-addressed hash table whose capacity is a power of two, so that a
+// sample costs a hash lookup however large the program is.
+//
+typedef struct
+{
+    um32_sampler_entry_pt       entries_p;
+    uint32_t                    mask;
+    uint32_t                    numEntries;
+    um32_sampler_generation_pt  generations_p;
+    uint32_t                    numGenerations;
+    uint32_t                    generationCapacity;
+    uint64_t                    numSamples;
+} um32_sampler_t;
+typedef um32_sampler_t* um32_sampler_pt;
+
+um32_sampler_pt um32_sampler_create(uint32_t length);
+void um32_sampler_free(um32_sampler_pt sampler_p);
+bool um32_sampler_beginGeneration(um32_sampler_pt sampler_p, uint32_t arrayId,
+                                  uint32_t length);
+bool um32_sampler_record(um32_sampler_pt sampler_p, uint32_t offset);
+void um32_sampler_print(const um32_sampler_t* sampler_p, FILE* file_p);
+bool um32_sampler_save(const um32_sampler_t* sampler_p, const char* fileName);
+
+#endif /* UM32_SAMPLER_H */
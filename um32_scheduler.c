@@ -0,0 +1,347 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#include "um32_scheduler.h"
+
+#include "um32_memory.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#define UM32_SCHEDULER_INITIAL_CAPACITY 64
+#define UM32_SCHEDULER_MAX_EVENTS       256
+
+um32_scheduler_pt
+um32_scheduler_create(uint64_t sliceInstructions,
+                      um32_scheduler_doneCallback_t doneCallback,
+                      void* doneContext_p)
+{
+    um32_scheduler_pt scheduler_p =
+        (um32_scheduler_pt)um32_memory_malloc(sizeof(um32_scheduler_t));
+    if (scheduler_p == NULL) { return NULL; }
+    memset(scheduler_p, 0, sizeof(um32_scheduler_t));
+
+    scheduler_p->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (scheduler_p->epollFd == -1)
+    {
+        um32_memory_free(scheduler_p);
+        return NULL;
+    }
+
+    scheduler_p->sliceInstructions = (sliceInstructions > 0)
+        ? sliceInstructions : UM32_SCHEDULER_DEFAULT_SLICE;
+    scheduler_p->doneCallback = doneCallback;
+    scheduler_p->doneContext_p = doneContext_p;
+
+    return scheduler_p;
+}
+
+// Frees the scheduler. Machines still held by it are not freed; they belong to
+// the host.
+//
+void
+um32_scheduler_free(um32_scheduler_pt scheduler_p)
+{
+    if (scheduler_p == NULL) { return; }
+
+    close(scheduler_p->epollFd);
+    um32_memory_free(scheduler_p->sessions_p);
+    um32_memory_free(scheduler_p->freeSessions_p);
+    um32_memory_free(scheduler_p->runQueue_p);
+    um32_memory_free(scheduler_p);
+}
+
+// Doubles the room for sessions. The run queue is a ring, so its entries are
+// unrolled to the front of the new buffer.
+//
+static bool
+um32_scheduler_grow(um32_scheduler_pt scheduler_p)
+{
+    uint32_t capacity = (scheduler_p->capacity > 0)
+        ? (scheduler_p->capacity * 2) : UM32_SCHEDULER_INITIAL_CAPACITY;
+
+    um32_scheduler_session_pt sessions_p = (um32_scheduler_session_pt)
+        um32_memory_realloc(scheduler_p->sessions_p,
+                            capacity * sizeof(um32_scheduler_session_t));
+    if (sessions_p == NULL) { return false; }
+    scheduler_p->sessions_p = sessions_p;
+
+    uint32_t* freeSessions_p = (uint32_t*)
+        um32_memory_realloc(scheduler_p->freeSessions_p,
+                            capacity * sizeof(uint32_t));
+    if (freeSessions_p == NULL) { return false; }
+    scheduler_p->freeSessions_p = freeSessions_p;
+
+    uint32_t* runQueue_p = (uint32_t*)
+        um32_memory_malloc(capacity * sizeof(uint32_t));
+    if (runQueue_p == NULL) { return false; }
+    for (uint32_t i=0; i<scheduler_p->runQueueLength; i++)
+    {
+        runQueue_p[i] = scheduler_p->runQueue_p[
+            (scheduler_p->runQueueHead + i) % scheduler_p->capacity];
+    }
+    um32_memory_free(scheduler_p->runQueue_p);
+    scheduler_p->runQueue_p = runQueue_p;
+    scheduler_p->runQueueHead = 0;
+
+    scheduler_p->capacity = capacity;
+    return true;
+}
+
+static void
+um32_scheduler_push(um32_scheduler_pt scheduler_p, uint32_t session)
+{
+    uint32_t tail = (scheduler_p->runQueueHead + scheduler_p->runQueueLength) %
+                    scheduler_p->capacity;
+    scheduler_p->runQueue_p[tail] = session;
+    scheduler_p->runQueueLength++;
+}
+
+static uint32_t
+um32_scheduler_pop(um32_scheduler_pt scheduler_p)
+{
+    uint32_t session = scheduler_p->runQueue_p[scheduler_p->runQueueHead];
+    scheduler_p->runQueueHead =
+        (scheduler_p->runQueueHead + 1) % scheduler_p->capacity;
+    scheduler_p->runQueueLength--;
+    return session;
+}
+
+// Hands a machine to the scheduler, reading console input from inputFd. The
+// descriptor is made non-blocking so an Input with nothing to read parks the
+// machine instead of the whole scheduler. Descriptors epoll cannot watch, such
+// as regular files, never run dry and are read as usual. Output goes to the
+// machine's output descriptor, which is the same as inputFd for a socket
+// console. A separate one is made non-blocking and watched as well, unless
+// epoll cannot take it, for instance because another session writes to it
+// too. The machine is runnable straight away.
+//
+bool
+um32_scheduler_add(um32_scheduler_pt scheduler_p, um32_machine_pt machine_p,
+                   int inputFd)
+{
+    if ((scheduler_p == NULL) || (machine_p == NULL) || (inputFd < 0))
+    {
+        return false;
+    }
+
+    if ((scheduler_p->numFreeSessions == 0) &&
+        (scheduler_p->numSessions == scheduler_p->capacity) &&
+        !um32_scheduler_grow(scheduler_p))
+    {
+        printf("Unable to add machine to scheduler.\n");
+        return false;
+    }
+
+    int flags = fcntl(inputFd, F_GETFL);
+    if ((flags == -1) || (fcntl(inputFd, F_SETFL, flags | O_NONBLOCK) == -1) ||
+        !um32_machine_setInput(machine_p, inputFd))
+    {
+        printf("Unable to add machine to scheduler.\n");
+        return false;
+    }
+
+    uint32_t session = (scheduler_p->numFreeSessions > 0)
+        ? scheduler_p->freeSessions_p[--scheduler_p->numFreeSessions]
+        : scheduler_p->numSessions++;
+
+    // Registered disarmed; parking arms it for a single wakeup
+    //
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLONESHOT;
+    event.data.u32 = session;
+    bool pollable =
+        (epoll_ctl(scheduler_p->epollFd, EPOLL_CTL_ADD, inputFd, &event) == 0);
+
+    int outputFd = machine_p->outputFd;
+    bool outputPollable = pollable;
+    if (outputFd != inputFd)
+    {
+        flags = fcntl(outputFd, F_GETFL);
+        outputPollable = (flags != -1) &&
+            (epoll_ctl(scheduler_p->epollFd, EPOLL_CTL_ADD, outputFd,
+                       &event) == 0);
+        if (outputPollable &&
+            (fcntl(outputFd, F_SETFL, flags | O_NONBLOCK) == -1))
+        {
+            epoll_ctl(scheduler_p->epollFd, EPOLL_CTL_DEL, outputFd, NULL);
+            outputPollable = false;
+        }
+    }
+
+    um32_scheduler_session_pt session_p = &(scheduler_p->sessions_p[session]);
+    session_p->machine_p = machine_p;
+    session_p->inputFd = inputFd;
+    session_p->outputFd = outputFd;
+    session_p->pollable = pollable;
+    session_p->outputPollable = outputPollable;
+    session_p->parked = false;
+
+    um32_scheduler_push(scheduler_p, session);
+    return true;
+}
+
+// Forgets a machine that has halted or failed and tells the host
+//
+static void
+um32_scheduler_retire(um32_scheduler_pt scheduler_p, uint32_t session,
+                      um32_machine_status_t status)
+{
+    um32_scheduler_session_pt session_p = &(scheduler_p->sessions_p[session]);
+    um32_machine_pt machine_p = session_p->machine_p;
+
+    if (session_p->pollable)
+    {
+        epoll_ctl(scheduler_p->epollFd, EPOLL_CTL_DEL, session_p->inputFd, NULL);
+    }
+    if (session_p->outputPollable && (session_p->outputFd != session_p->inputFd))
+    {
+        epoll_ctl(scheduler_p->epollFd, EPOLL_CTL_DEL, session_p->outputFd, NULL);
+    }
+    session_p->machine_p = NULL;
+    scheduler_p->freeSessions_p[scheduler_p->numFreeSessions++] = session;
+
+    if (scheduler_p->doneCallback != NULL)
+    {
+        scheduler_p->doneCallback(scheduler_p->doneContext_p, machine_p, status);
+    }
+}
+
+// Arms the input descriptor of a machine waiting for input, or the output
+// descriptor of one waiting for output. Returns false if it cannot be watched,
+// in which case the machine stays runnable.
+//
+static bool
+um32_scheduler_park(um32_scheduler_pt scheduler_p, uint32_t session,
+                    bool output)
+{
+    um32_scheduler_session_pt session_p = &(scheduler_p->sessions_p[session]);
+    if (!(output ? session_p->outputPollable : session_p->pollable))
+    {
+        return false;
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = output ? (EPOLLOUT | EPOLLONESHOT)
+                          : (EPOLLIN | EPOLLRDHUP | EPOLLONESHOT);
+    event.data.u32 = session;
+    if (epoll_ctl(scheduler_p->epollFd, EPOLL_CTL_MOD,
+                  output ? session_p->outputFd : session_p->inputFd,
+                  &event) == -1)
+    {
+        return false;
+    }
+
+    session_p->parked = true;
+    scheduler_p->numParked++;
+    return true;
+}
+
+// Moves parked machines whose input became readable, whose output became
+// writable, or which hung up, back to the run queue. Blocks only when nothing
+// else can run.
+//
+static bool
+um32_scheduler_wake(um32_scheduler_pt scheduler_p)
+{
+    struct epoll_event events_a[UM32_SCHEDULER_MAX_EVENTS];
+    int timeout = (scheduler_p->runQueueLength > 0) ? 0 : -1;
+
+    int numEvents = epoll_wait(scheduler_p->epollFd, events_a,
+                               UM32_SCHEDULER_MAX_EVENTS, timeout);
+    if (numEvents == -1)
+    {
+        if (errno == EINTR) { return true; }
+        printf("Error waiting for input.\n");
+        return false;
+    }
+
+    // epoll reports errors and hang-ups even on descriptors that are not
+    // armed, and a machine that is not parked is already queued
+    //
+    for (int i=0; i<numEvents; i++)
+    {
+        uint32_t session = events_a[i].data.u32;
+        if (!scheduler_p->sessions_p[session].parked) { continue; }
+
+        scheduler_p->sessions_p[session].parked = false;
+        scheduler_p->numParked--;
+        um32_scheduler_push(scheduler_p, session);
+    }
+
+    return true;
+}
+
+// Runs every machine until it halts or fails. Each pass wakes machines whose
+// console is ready and then gives every runnable machine one slice. Returns
+// false if waiting for input failed, leaving the remaining machines with the
+// scheduler.
+//
+bool
+um32_scheduler_run(um32_scheduler_pt scheduler_p)
+{
+    if (scheduler_p == NULL) { return false; }
+
+    while ((scheduler_p->runQueueLength > 0) || (scheduler_p->numParked > 0))
+    {
+        if (!um32_scheduler_wake(scheduler_p)) { return false; }
+
+        for (uint32_t i=scheduler_p->runQueueLength; i>0; i--)
+        {
+            uint32_t session = um32_scheduler_pop(scheduler_p);
+            um32_machine_status_t status = um32_machine_runFor(
+                scheduler_p->sessions_p[session].machine_p,
+                scheduler_p->sliceInstructions);
+
+            if (status == UM32_MACHINE_STATUS_RUNNING)
+            {
+                um32_scheduler_push(scheduler_p, session);
+            }
+            else if ((status == UM32_MACHINE_STATUS_NEEDS_INPUT) ||
+                     (status == UM32_MACHINE_STATUS_NEEDS_OUTPUT))
+            {
+                if (!um32_scheduler_park(scheduler_p, session,
+                        status == UM32_MACHINE_STATUS_NEEDS_OUTPUT))
+                {
+                    um32_scheduler_push(scheduler_p, session);
+                }
+            }
+            else
+            {
+                um32_scheduler_retire(scheduler_p, session, status);
+            }
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,95 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#ifndef UM32_SCHEDULER_H
+#define UM32_SCHEDULER_H
+
+#include "um32_machine.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Default number of instructions a machine runs before the next one gets a turn
+//
+#define UM32_SCHEDULER_DEFAULT_SLICE 100000
+
+// Called when a machine halts or fails. The scheduler has already forgotten the
+// machine, which belongs to the host again.
+//
+typedef void (*um32_scheduler_doneCallback_t)(void* context_p,
+                                              um32_machine_pt machine_p,
+                                              um32_machine_status_t status);
+
+// A machine held by the scheduler, identified by its index in sessions_p. The
+// output descriptor is only registered with epoll on its own when it differs
+// from the input descriptor.
+//
+typedef struct
+{
+    um32_machine_pt  machine_p;
+    int              inputFd;
+    int              outputFd;
+    bool             pollable;
+    bool             outputPollable;
+    bool             parked;
+} um32_scheduler_session_t;
+typedef um32_scheduler_session_t* um32_scheduler_session_pt;
+
+// Runs many machines on one thread. Runnable machines take turns in slices of
+// sliceInstructions from a round-robin queue. A machine that executes Input
+// with no data available is parked until epoll reports its input descriptor
+// readable, so idle machines cost nothing but memory. Likewise a machine whose
+// output descriptor is full is parked until it is writable, so a client that
+// stops reading only stalls its own machine.
+//
+typedef struct
+{
+    int                            epollFd;
+    uint64_t                       sliceInstructions;
+    um32_scheduler_session_pt      sessions_p;
+    uint32_t                       numSessions;
+    uint32_t                       capacity;
+    uint32_t*                      freeSessions_p;
+    uint32_t                       numFreeSessions;
+    uint32_t*                      runQueue_p;
+    uint32_t                       runQueueHead;
+    uint32_t                       runQueueLength;
+    uint32_t                       numParked;
+    um32_scheduler_doneCallback_t  doneCallback;
+    void*                          doneContext_p;
+} um32_scheduler_t;
+typedef um32_scheduler_t* um32_scheduler_pt;
+
+um32_scheduler_pt um32_scheduler_create(uint64_t sliceInstructions,
+                                        um32_scheduler_doneCallback_t doneCallback,
+                                        void* doneContext_p);
+void um32_scheduler_free(um32_scheduler_pt scheduler_p);
+bool um32_scheduler_add(um32_scheduler_pt scheduler_p, um32_machine_pt machine_p,
+                        int inputFd);
+bool um32_scheduler_run(um32_scheduler_pt scheduler_p);
+
+#endif /* UM32_SCHEDULER_H */
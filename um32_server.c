@@ -0,0 +1,536 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#include "um32_server.h"
+
+#include "um32_machine.h"
+#include "um32_memory.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Workers exit with this status when they can no longer accept requests, which
+// stops the server instead of forking replacements that would fail the same way
+//
+#define UM32_SERVER_WORKER_FAILED 2
+
+typedef struct
+{
+    const char*            name_p;
+    um32_array_storage_pt  image_p;
+} um32_server_program_t;
+
+typedef struct
+{
+    int                     listenFd;
+    um32_server_program_t*  programs_p;
+    int                     numPrograms;
+    pid_t*                  workers_p;
+    int                     numWorkers;
+} um32_server_t;
+typedef um32_server_t* um32_server_pt;
+
+static volatile sig_atomic_t um32_server_stopRequested = 0;
+
+// Connection of the request a worker is running, watched for hang-ups
+//
+static volatile int um32_server_connectionFd = -1;
+
+static void
+um32_server_handleStop(int signalNum)
+{
+    (void)signalNum;
+    um32_server_stopRequested = 1;
+}
+
+// A client that goes away, for instance because its user pressed Ctrl-C, hangs
+// up the connection. The client never sends anything after its request, so any
+// readiness reported by SIGIO is the hang-up, and the run is abandoned by
+// ending the worker; the server forks another in its place.
+//
+static void
+um32_server_handleHangup(int signalNum)
+{
+    (void)signalNum;
+
+    int fd = um32_server_connectionFd;
+    if (fd == -1) { return; }
+
+    int savedErrno = errno;
+    char byte;
+    if (recv(fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT) != -1)
+    {
+        _exit(0);
+    }
+    if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+    {
+        _exit(0);
+    }
+    errno = savedErrno;
+}
+
+static const char*
+um32_server_baseName(const char* path)
+{
+    const char* slash_p = strrchr(path, '/');
+    return (slash_p == NULL) ? path : (slash_p + 1);
+}
+
+static bool
+um32_server_sendReply(int connectionFd, uint32_t status)
+{
+    um32_server_reply_t reply;
+    reply.status = status;
+
+    return send(connectionFd, &reply, sizeof(reply), MSG_NOSIGNAL) ==
+           (ssize_t)sizeof(reply);
+}
+
+// Receives a request and the two descriptors passed with it. Returns false,
+// with no descriptors left open, if the request is malformed.
+//
+static bool
+um32_server_receiveRequest(int connectionFd, um32_server_request_t* request_p,
+                           int* inputFd_p, int* outputFd_p)
+{
+    union
+    {
+        struct cmsghdr  header;
+        char            buffer_a[CMSG_SPACE(2 * sizeof(int))];
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    struct iovec iov = { request_p, sizeof(um32_server_request_t) };
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer_a;
+    message.msg_controllen = sizeof(control.buffer_a);
+
+    ssize_t numBytes;
+    do
+    {
+        numBytes = recvmsg(connectionFd, &message, MSG_CMSG_CLOEXEC);
+    } while ((numBytes == -1) && (errno == EINTR));
+
+    // Close whatever descriptors arrived with a message that is not a request
+    //
+    int fds_a[2] = { -1, -1 };
+    int numFds = 0;
+    for (struct cmsghdr* cmsg_p = CMSG_FIRSTHDR(&message); cmsg_p != NULL;
+         cmsg_p = CMSG_NXTHDR(&message, cmsg_p))
+    {
+        if ((cmsg_p->cmsg_level != SOL_SOCKET) ||
+            (cmsg_p->cmsg_type != SCM_RIGHTS))
+        {
+            continue;
+        }
+
+        int count = (int)((cmsg_p->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        for (int i=0; i<count; i++)
+        {
+            int fd;
+            memcpy(&fd, CMSG_DATA(cmsg_p) + i * sizeof(int), sizeof(int));
+            if (numFds < 2) { fds_a[numFds++] = fd; }
+            else { close(fd); }
+        }
+    }
+
+    if ((numBytes != (ssize_t)sizeof(um32_server_request_t)) ||
+        ((message.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) != 0) || (numFds != 2))
+    {
+        if (fds_a[0] != -1) { close(fds_a[0]); }
+        if (fds_a[1] != -1) { close(fds_a[1]); }
+        return false;
+    }
+
+    request_p->name_a[UM32_SERVER_MAX_NAME - 1] = '\0';
+    *inputFd_p = fds_a[0];
+    *outputFd_p = fds_a[1];
+
+    return true;
+}
+
+// Runs one request to completion on the descriptors it passed and replies with
+// the machine's final status
+//
+static void
+um32_server_runRequest(um32_server_pt server_p, int connectionFd)
+{
+    um32_server_request_t request;
+    int inputFd;
+    int outputFd;
+    if (!um32_server_receiveRequest(connectionFd, &request, &inputFd, &outputFd))
+    {
+        return;
+    }
+
+    um32_server_program_t* program_p = NULL;
+    for (int i=0; i<server_p->numPrograms; i++)
+    {
+        if (strcmp(server_p->programs_p[i].name_p, request.name_a) == 0)
+        {
+            program_p = &(server_p->programs_p[i]);
+            break;
+        }
+    }
+
+    uint32_t status = UM32_SERVER_UNKNOWN_PROGRAM;
+    um32_machine_pt machine_p = NULL;
+    if ((program_p != NULL) &&
+        ((machine_p = um32_machine_create()) != NULL) &&
+        um32_machine_initFromImage(machine_p, program_p->image_p))
+    {
+        // Watch for the client hanging up while its program runs, and check
+        // once in case it already has
+        //
+        um32_server_connectionFd = connectionFd;
+        fcntl(connectionFd, F_SETOWN, getpid());
+        fcntl(connectionFd, F_SETFL, fcntl(connectionFd, F_GETFL) | O_ASYNC);
+        um32_server_handleHangup(SIGIO);
+
+        um32_machine_setInput(machine_p, inputFd);
+        um32_machine_setOutput(machine_p, outputFd);
+        um32_machine_setOutputBuffering(machine_p,
+            ((request.flags & UM32_SERVER_LINE_BUFFERED) != 0)
+                ? UM32_MACHINE_OUTPUT_LINE_BUFFERED
+                : UM32_MACHINE_OUTPUT_FULLY_BUFFERED);
+
+        um32_machine_status_t machineStatus = UM32_MACHINE_STATUS_RUNNING;
+        while ((machineStatus == UM32_MACHINE_STATUS_RUNNING) ||
+               (machineStatus == UM32_MACHINE_STATUS_NEEDS_INPUT) ||
+               (machineStatus == UM32_MACHINE_STATUS_NEEDS_OUTPUT))
+        {
+            if (machineStatus == UM32_MACHINE_STATUS_NEEDS_INPUT)
+            {
+                struct pollfd pollFd = { inputFd, POLLIN, 0 };
+                poll(&pollFd, 1, -1);
+            }
+            else if (machineStatus == UM32_MACHINE_STATUS_NEEDS_OUTPUT)
+            {
+                struct pollfd pollFd = { outputFd, POLLOUT, 0 };
+                poll(&pollFd, 1, -1);
+            }
+            machineStatus = um32_machine_run(machine_p);
+        }
+
+        fcntl(connectionFd, F_SETFL, fcntl(connectionFd, F_GETFL) & ~O_ASYNC);
+        um32_server_connectionFd = -1;
+        status = (uint32_t)machineStatus;
+    }
+    else if (program_p != NULL)
+    {
+        status = UM32_MACHINE_STATUS_FAULT;
+    }
+
+    um32_machine_free(machine_p);
+    close(outputFd);
+    close(inputFd);
+
+    um32_server_sendReply(connectionFd, status);
+}
+
+static void
+um32_server_worker(um32_server_pt server_p)
+{
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    sigemptyset(&action.sa_mask);
+    action.sa_handler = SIG_DFL;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    action.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &action, NULL);
+    action.sa_handler = um32_server_handleHangup;
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGIO, &action, NULL);
+
+    for (;;)
+    {
+        int connectionFd = accept4(server_p->listenFd, NULL, NULL, SOCK_CLOEXEC);
+        if (connectionFd == -1)
+        {
+            if ((errno == EINTR) || (errno == ECONNABORTED)) { continue; }
+            printf("Unable to accept requests.\n");
+            _exit(UM32_SERVER_WORKER_FAILED);
+        }
+
+        um32_server_runRequest(server_p, connectionFd);
+        close(connectionFd);
+    }
+}
+
+static pid_t
+um32_server_startWorker(um32_server_pt server_p)
+{
+    fflush(stdout);
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        um32_server_worker(server_p);
+    }
+
+    return pid;
+}
+
+// Binds a listening socket to socketName, replacing a socket left behind by a
+// server that did not shut down cleanly
+//
+static int
+um32_server_listen(const char* socketName)
+{
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socketName) >= sizeof(address.sun_path)) { return -1; }
+    strcpy(address.sun_path, socketName);
+
+    struct stat fileStat;
+    if ((lstat(socketName, &fileStat) == 0) && S_ISSOCK(fileStat.st_mode))
+    {
+        unlink(socketName);
+    }
+
+    int listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenFd == -1) { return -1; }
+
+    if ((bind(listenFd, (struct sockaddr*)&address, sizeof(address)) == -1) ||
+        (listen(listenFd, SOMAXCONN) == -1))
+    {
+        close(listenFd);
+        return -1;
+    }
+
+    return listenFd;
+}
+
+bool
+um32_server_serve(const char* socketName, char* const* programNames,
+                  int numPrograms, int numWorkers)
+{
+    um32_server_t server;
+    memset(&server, 0, sizeof(server));
+    server.listenFd = -1;
+
+    // Load every program image before forking so that the workers share them
+    //
+    server.programs_p = (um32_server_program_t*)um32_memory_malloc(
+        (size_t)numPrograms * sizeof(um32_server_program_t));
+    server.workers_p = (pid_t*)um32_memory_malloc(
+        (size_t)numWorkers * sizeof(pid_t));
+    bool result = (server.programs_p != NULL) && (server.workers_p != NULL);
+    if (!result) { printf("Unable to allocate server.\n"); }
+
+    for (int i=0; result && (i<numPrograms); i++)
+    {
+        FILE* file_p = fopen(programNames[i], "r");
+        if (file_p == NULL)
+        {
+            printf("Unable to open file %s.\n", programNames[i]);
+            result = false;
+            break;
+        }
+
+        server.programs_p[i].name_p = um32_server_baseName(programNames[i]);
+        server.programs_p[i].image_p = um32_machine_createImage(file_p);
+        fclose(file_p);
+        if (server.programs_p[i].image_p == NULL)
+        {
+            printf("Unable to load program %s.\n", programNames[i]);
+            result = false;
+            break;
+        }
+        server.numPrograms++;
+    }
+
+    if (result && ((server.listenFd = um32_server_listen(socketName)) == -1))
+    {
+        printf("Unable to listen on %s.\n", socketName);
+        result = false;
+    }
+
+    // SIGINT and SIGTERM stop the server. They are installed without
+    // SA_RESTART so that they interrupt the wait for workers.
+    //
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    sigemptyset(&action.sa_mask);
+    action.sa_handler = um32_server_handleStop;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    for (int i=0; result && (i<numWorkers); i++)
+    {
+        server.workers_p[i] = um32_server_startWorker(&server);
+        if (server.workers_p[i] == -1)
+        {
+            printf("Unable to start worker.\n");
+            result = false;
+            break;
+        }
+        server.numWorkers++;
+    }
+
+    // Replace workers as they end, whether by a crash in the program they ran
+    // or by a client hanging up
+    //
+    while (result && !um32_server_stopRequested)
+    {
+        int waitStatus;
+        pid_t pid = waitpid(-1, &waitStatus, 0);
+        if (pid == -1)
+        {
+            if (errno == EINTR) { continue; }
+            break;
+        }
+
+        for (int i=0; i<server.numWorkers; i++)
+        {
+            if (server.workers_p[i] != pid) { continue; }
+
+            if (WIFEXITED(waitStatus) &&
+                (WEXITSTATUS(waitStatus) == UM32_SERVER_WORKER_FAILED))
+            {
+                result = false;
+            }
+            server.workers_p[i] = result ? um32_server_startWorker(&server) : -1;
+            break;
+        }
+    }
+
+    // Stop the remaining workers, abandoning the runs in progress
+    //
+    for (int i=0; i<server.numWorkers; i++)
+    {
+        if (server.workers_p[i] <= 0) { continue; }
+        kill(server.workers_p[i], SIGTERM);
+        waitpid(server.workers_p[i], NULL, 0);
+    }
+
+    if (server.listenFd != -1)
+    {
+        close(server.listenFd);
+        unlink(socketName);
+    }
+    for (int i=0; i<server.numPrograms; i++)
+    {
+        um32_array_storage_freeShared(server.programs_p[i].image_p);
+    }
+    um32_memory_free(server.workers_p);
+    um32_memory_free(server.programs_p);
+
+    return result;
+}
+
+bool
+um32_server_connect(const char* socketName, const char* programName,
+                    int inputFd, int outputFd, uint32_t flags,
+                    uint32_t* status_p)
+{
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socketName) >= sizeof(address.sun_path)) { return false; }
+    strcpy(address.sun_path, socketName);
+
+    um32_server_request_t request;
+    memset(&request, 0, sizeof(request));
+    request.flags = flags;
+    if (strlen(programName) >= UM32_SERVER_MAX_NAME) { return false; }
+    strcpy(request.name_a, programName);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) { return false; }
+    if (connect(fd, (struct sockaddr*)&address, sizeof(address)) == -1)
+    {
+        close(fd);
+        return false;
+    }
+
+    // Pass the console descriptors along with the request
+    //
+    union
+    {
+        struct cmsghdr  header;
+        char            buffer_a[CMSG_SPACE(2 * sizeof(int))];
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    struct iovec iov = { &request, sizeof(request) };
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer_a;
+    message.msg_controllen = sizeof(control.buffer_a);
+
+    struct cmsghdr* cmsg_p = CMSG_FIRSTHDR(&message);
+    cmsg_p->cmsg_level = SOL_SOCKET;
+    cmsg_p->cmsg_type = SCM_RIGHTS;
+    cmsg_p->cmsg_len = CMSG_LEN(2 * sizeof(int));
+    int fds_a[2] = { inputFd, outputFd };
+    memcpy(CMSG_DATA(cmsg_p), fds_a, sizeof(fds_a));
+
+    if (sendmsg(fd, &message, MSG_NOSIGNAL) != (ssize_t)sizeof(request))
+    {
+        close(fd);
+        return false;
+    }
+
+    // Wait for the run to finish
+    //
+    um32_server_reply_t reply;
+    size_t numReceived = 0;
+    while (numReceived < sizeof(reply))
+    {
+        ssize_t numBytes = recv(fd, (char*)&reply + numReceived,
+                                sizeof(reply) - numReceived, 0);
+        if ((numBytes == -1) && (errno == EINTR)) { continue; }
+        if (numBytes <= 0)
+        {
+            close(fd);
+            return false;
+        }
+        numReceived += (size_t)numBytes;
+    }
+
+    close(fd);
+    *status_p = reply.status;
+
+    return true;
+}
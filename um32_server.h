@@ -0,0 +1,81 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#ifndef UM32_SERVER_H
+#define UM32_SERVER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Longest program name a run request can carry, including the terminator
+//
+#define UM32_SERVER_MAX_NAME 256
+
+// Request flags
+//
+#define UM32_SERVER_LINE_BUFFERED 0x1
+
+// Sent by a client along with its input and output descriptors. The program is
+// named by the file name the server loaded it from, without its directory.
+//
+typedef struct
+{
+    uint32_t  flags;
+    char      name_a[UM32_SERVER_MAX_NAME];
+} um32_server_request_t;
+
+// Sent back once the run is over. status is a um32_machine_status_t, or
+// UM32_SERVER_UNKNOWN_PROGRAM.
+//
+typedef struct
+{
+    uint32_t  status;
+} um32_server_reply_t;
+
+#define UM32_SERVER_UNKNOWN_PROGRAM 0xffffffff
+
+// Loads the programs, listens on the Unix domain socket socketName and keeps
+// numWorkers processes forked to run requests, one at a time each. Every
+// worker starts its machines from the images loaded before it was forked,
+// which it shares with the server until a program amends its 0 array. Returns
+// false if the server could not be started, or true once it is stopped by
+// SIGINT or SIGTERM.
+//
+bool um32_server_serve(const char* socketName, char* const* programNames,
+                       int numPrograms, int numWorkers);
+
+// Asks the server listening on socketName to run the named program on inputFd
+// and outputFd, and waits for it to finish. Returns the machine's final status,
+// or UM32_SERVER_UNKNOWN_PROGRAM; returns false if the server could not be
+// reached.
+//
+bool um32_server_connect(const char* socketName, const char* programName,
+                         int inputFd, int outputFd, uint32_t flags,
+                         uint32_t* status_p);
+
+#endif /* UM32_SERVER_H */
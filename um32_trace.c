@@ -0,0 +1,248 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#include "um32_trace.h"
+
+#include "um32_memory.h"
+#include "um32_platter.h"
+#include <fcntl.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <unistd.h>
+
+// Trace files start with this header, followed by the records from oldest to
+// newest. They are written in host byte order and only read back on hosts with
+// the same order.
+//
+#define UM32_TRACE_MAGIC       "UM32TRCE"
+#define UM32_TRACE_VERSION     1
+#define UM32_TRACE_BYTE_ORDER  0x01020304
+
+typedef struct
+{
+    char      magic_a[8];
+    uint32_t  version;
+    uint32_t  byteOrder;
+    uint64_t  numRecorded;
+    uint64_t  numRecords;
+} um32_trace_header_t;
+
+// Trace written by the signal handler installed by um32_trace_saveOnSignal
+//
+static const um32_trace_t* um32_trace_signalTrace_p = NULL;
+static const char* um32_trace_signalFileName = NULL;
+
+// Creates a tracer keeping the last numRecords records, rounded up to a power
+// of two
+//
+um32_trace_pt
+um32_trace_create(uint32_t numRecords)
+{
+    if ((numRecords == 0) || (numRecords > (UINT32_C(1) << 31)))
+    {
+        return NULL;
+    }
+
+    uint32_t capacity = 1;
+    while (capacity < numRecords) { capacity <<= 1; }
+
+    um32_trace_pt trace_p =
+        (um32_trace_pt)um32_memory_malloc(sizeof(um32_trace_t));
+    if (trace_p == NULL) { return NULL; }
+
+    trace_p->records_p = (um32_trace_record_pt)um32_memory_malloc(
+        (size_t)capacity * sizeof(um32_trace_record_t));
+    if (trace_p->records_p == NULL)
+    {
+        um32_memory_free(trace_p);
+        return NULL;
+    }
+    trace_p->mask = capacity - 1;
+    trace_p->numRecorded = 0;
+
+    return trace_p;
+}
+
+void
+um32_trace_free(um32_trace_pt trace_p)
+{
+    if (trace_p == NULL) { return; }
+
+    if (um32_trace_signalTrace_p == trace_p) { um32_trace_signalTrace_p = NULL; }
+    um32_memory_free(trace_p->records_p);
+    um32_memory_free(trace_p);
+}
+
+// Writes all of size bytes, retrying short writes
+//
+static bool
+um32_trace_writeAll(int fd, const void* buf_p, size_t size)
+{
+    const char* cur_p = (const char*)buf_p;
+    while (size > 0)
+    {
+        ssize_t result = write(fd, cur_p, size);
+        if (result <= 0) { return false; }
+        cur_p += result;
+        size -= (size_t)result;
+    }
+
+    return true;
+}
+
+// Writes the trace to fd. Only calls write, so it may be used from a signal
+// handler.
+//
+bool
+um32_trace_writeFd(const um32_trace_t* trace_p, int fd)
+{
+    uint64_t capacity = (uint64_t)trace_p->mask + 1;
+    uint64_t numRecorded = trace_p->numRecorded;
+    uint64_t numRecords = (numRecorded < capacity) ? numRecorded : capacity;
+
+    um32_trace_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic_a, UM32_TRACE_MAGIC, sizeof(header.magic_a));
+    header.version = UM32_TRACE_VERSION;
+    header.byteOrder = UM32_TRACE_BYTE_ORDER;
+    header.numRecorded = numRecorded;
+    header.numRecords = numRecords;
+    if (!um32_trace_writeAll(fd, &header, sizeof(header))) { return false; }
+
+    // Once the ring has wrapped the oldest record is the next to be replaced
+    //
+    uint64_t first = (numRecorded - numRecords) & trace_p->mask;
+    uint64_t numTail = capacity - first;
+    if (numTail > numRecords) { numTail = numRecords; }
+
+    return um32_trace_writeAll(fd, trace_p->records_p + first,
+                               (size_t)numTail * sizeof(um32_trace_record_t)) &&
+           um32_trace_writeAll(fd, trace_p->records_p,
+                               (size_t)(numRecords - numTail) *
+                               sizeof(um32_trace_record_t));
+}
+
+bool
+um32_trace_save(const um32_trace_t* trace_p, const char* fileName)
+{
+    int fd = open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) { return false; }
+
+    bool result = um32_trace_writeFd(trace_p, fd);
+    return (close(fd) == 0) && result;
+}
+
+static void
+um32_trace_handleSignal(int signalNum)
+{
+    if (um32_trace_signalTrace_p != NULL)
+    {
+        int fd = open(um32_trace_signalFileName, O_WRONLY | O_CREAT | O_TRUNC,
+                      0644);
+        if (fd != -1)
+        {
+            um32_trace_writeFd(um32_trace_signalTrace_p, fd);
+            close(fd);
+        }
+    }
+
+    // The default action was restored on entry, so this terminates the
+    // process as the signal would have
+    //
+    raise(signalNum);
+}
+
+// Writes the trace to fileName if the process is interrupted, terminated or
+// crashes. The default action of the signal follows. Only one trace can be
+// saved this way.
+//
+bool
+um32_trace_saveOnSignal(const um32_trace_t* trace_p, const char* fileName)
+{
+    static const int signals_a[] = { SIGINT, SIGTERM, SIGSEGV, SIGBUS, SIGABRT };
+
+    um32_trace_signalTrace_p = trace_p;
+    um32_trace_signalFileName = fileName;
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = um32_trace_handleSignal;
+    action.sa_flags = SA_RESETHAND;
+    sigemptyset(&action.sa_mask);
+
+    for (size_t i=0; i<sizeof(signals_a)/sizeof(signals_a[0]); i++)
+    {
+        if (sigaction(signals_a[i], &action, NULL) == -1) { return false; }
+    }
+
+    return true;
+}
+
+// Pretty-prints a trace file, one instruction per line from oldest to newest
+//
+bool
+um32_trace_print(const char* fileName, FILE* file_p)
+{
+    FILE* trace_p = fopen(fileName, "rb");
+    if (trace_p == NULL) { return false; }
+
+    um32_trace_header_t header;
+    if ((fread(&header, sizeof(header), 1, trace_p) != 1) ||
+        (memcmp(header.magic_a, UM32_TRACE_MAGIC, sizeof(header.magic_a)) != 0) ||
+        (header.version != UM32_TRACE_VERSION) ||
+        (header.byteOrder != UM32_TRACE_BYTE_ORDER))
+    {
+        fclose(trace_p);
+        return false;
+    }
+
+    fprintf(file_p, "Instructions traced:  %" PRIu64 " (last %" PRIu64
+            " shown)\n", header.numRecorded, header.numRecords);
+
+    // Number the records by their position in the whole run
+    //
+    uint64_t seq = header.numRecorded - header.numRecords;
+    um32_trace_record_t record;
+    char buf_a[128];
+    uint64_t i = 0;
+    for (; (i < header.numRecords) &&
+           (fread(&record, sizeof(record), 1, trace_p) == 1); i++)
+    {
+        um32_platter_toString(um32_platter_fromUInt32(record.platter), buf_a);
+        fprintf(file_p, "%12" PRIu64 "  %10" PRIu32 "  %s\n            ",
+                seq + i, record.offset, buf_a);
+        for (int r=0; r<UM32_TRACE_NUM_REGISTERS; r++)
+        {
+            fprintf(file_p, " r%d=%08" PRIx32, r, record.reg_a[r]);
+        }
+        fprintf(file_p, "\n");
+    }
+
+    fclose(trace_p);
+    return i == header.numRecords;
+}
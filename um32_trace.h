@@ -0,0 +1,89 @@
+//******************************************************************************
+//
+// Copyright (c) 2019, Brandon To
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of the author nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+//******************************************************************************
+#ifndef UM32_TRACE_H
+#define UM32_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Number of records kept by default, the most recent instructions before the
+// trace is written
+//
+#define UM32_TRACE_DEFAULT_RECORDS 65536
+
+#define UM32_TRACE_NUM_REGISTERS 8
+
+// One executed instruction: its offset into the '0' array, the raw platter and
+// the registers as they were before it was discharged
+//
+typedef struct
+{
+    uint32_t  offset;
+    uint32_t  platter;
+    uint32_t  reg_a[UM32_TRACE_NUM_REGISTERS];
+} um32_trace_record_t;
+typedef um32_trace_record_t* um32_trace_record_pt;
+
+// Execution tracer. Records are written to a ring buffer whose size is a power
+// of two, overwriting the oldest, so tracing costs one fixed-size copy per
+// instruction and never touches the disk until the trace is written out.
+//
+typedef struct
+{
+    um32_trace_record_pt  records_p;
+    uint32_t              mask;
+    uint64_t              numRecorded;
+} um32_trace_t;
+typedef um32_trace_t* um32_trace_pt;
+
+um32_trace_pt um32_trace_create(uint32_t numRecords);
+void um32_trace_free(um32_trace_pt trace_p);
+bool um32_trace_writeFd(const um32_trace_t* trace_p, int fd);
+bool um32_trace_save(const um32_trace_t* trace_p, const char* fileName);
+bool um32_trace_saveOnSignal(const um32_trace_t* trace_p, const char* fileName);
+bool um32_trace_print(const char* fileName, FILE* file_p);
+
+// Records an instruction about to be discharged
+//
+static inline void
+um32_trace_record(um32_trace_pt trace_p, uint32_t offset, uint32_t platter,
+                  const uint32_t* reg_a)
+{
+    um32_trace_record_pt record_p =
+        &(trace_p->records_p[trace_p->numRecorded & trace_p->mask]);
+    trace_p->numRecorded++;
+
+    record_p->offset = offset;
+    record_p->platter = platter;
+    memcpy(record_p->reg_a, reg_a, sizeof(record_p->reg_a));
+}
+
+#endif /* UM32_TRACE_H */